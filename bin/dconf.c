@@ -415,20 +415,30 @@ path_compare (const void *a,
 }
 
 /**
- * add_to_keyfile:
+ * dump_directory:
  * @dir_src: a dconf source dir
  * @dir_dst: a key-file destination dir
+ * @first_group: %TRUE until the first group has been written
  *
- * Copy directory contents from dconf to key-file.
+ * Write directory contents from dconf to stdout in key-file format.
+ *
+ * The output is produced incrementally, one group at a time, so only
+ * the listing of the dirs along the current path is held in memory.
+ * Keys of a single dir are read together with dconf_client_read_many().
+ * The format matches what g_key_file_to_data() would produce: groups
+ * are separated by a single empty line and empty groups are omitted.
  **/
-static void 
-add_to_keyfile (GKeyFile    *kf,
-                DConfClient *client,
+static void
+dump_directory (DConfClient *client,
                 const gchar *dir_src,
-                const gchar *dir_dst)
+                const gchar *dir_dst,
+                gboolean    *first_group)
 {
   g_autofree gchar *group = NULL;
+  g_autofree GVariant **values = NULL;
+  g_autoptr(GPtrArray) keys = NULL;
   g_auto(GStrv) items = NULL;
+  gboolean group_written = FALSE;
   gint length;
   gsize n;
 
@@ -447,24 +457,44 @@ add_to_keyfile (GKeyFile    *kf,
   items = dconf_client_list (client, dir_src, &length);
   qsort (items, length, sizeof (items[0]), path_compare);
 
-  for (gchar **item = items; *item; ++item)
+  /* path_compare() sorts keys before dirs, so the keys form a prefix. */
+  keys = g_ptr_array_new_with_free_func (g_free);
+  for (n = 0; items[n] != NULL && !g_str_has_suffix (items[n], "/"); n++)
+    g_ptr_array_add (keys, g_strconcat (dir_src, items[n], NULL));
+  g_ptr_array_add (keys, NULL);
+
+  values = dconf_client_read_many (client, (const gchar * const *) keys->pdata,
+                                   DCONF_READ_FLAGS_NONE, NULL);
+
+  for (gsize i = 0; i < n; i++)
     {
-      g_autofree gchar *path = g_strconcat (dir_src, *item, NULL);
+      g_autoptr(GVariant) value = values[i];
+      g_autofree gchar *value_str = NULL;
 
-      if (g_str_has_suffix (*item, "/"))
-        {
-          g_autofree gchar *subdir = g_strconcat (dir_dst, *item, NULL);
-          add_to_keyfile (kf, client, path, subdir);
-        }
-      else
+      if (value == NULL)
+        continue;
+
+      if (!group_written)
         {
-          g_autoptr(GVariant) value = dconf_client_read (client, path);
-          if (value != NULL)
-            {
-              g_autofree gchar *value_str = g_variant_print (value, TRUE);
-              g_key_file_set_value (kf, group, *item, value_str);
-            }
+          g_printf ("%s[%s]\n", *first_group ? "" : "\n", group);
+          *first_group = FALSE;
+          group_written = TRUE;
         }
+
+      value_str = g_variant_print (value, TRUE);
+      g_printf ("%s=%s\n", items[i], value_str);
+    }
+
+  /* Release the values and key names before descending. */
+  g_clear_pointer (&values, g_free);
+  g_clear_pointer (&keys, g_ptr_array_unref);
+
+  for (gchar **item = items + n; *item; ++item)
+    {
+      g_autofree gchar *path = g_strconcat (dir_src, *item, NULL);
+      g_autofree gchar *subdir = g_strconcat (dir_dst, *item, NULL);
+
+      dump_directory (client, path, subdir, first_group);
     }
 }
 
@@ -473,10 +503,9 @@ dconf_dump (const gchar **argv,
             GError      **error)
 {
   const gchar *dir;
+  gboolean first_group = TRUE;
   g_autoptr(GError) local_error = NULL;
-  g_autoptr(GKeyFile) kf = NULL;
   g_autoptr(DConfClient) client = NULL;
-  g_autofree gchar *data = NULL;
 
   dir = argv[0];
   if (!dconf_is_dir (dir, &local_error))
@@ -485,40 +514,61 @@ dconf_dump (const gchar **argv,
   if (argv[1] != NULL)
     return option_error_set (error, "too many arguments");
 
-  kf = g_key_file_new ();
   client = dconf_client_new ();
 
-  add_to_keyfile (kf, client, dir, "/");
-
-  data = g_key_file_to_data (kf, NULL, NULL);
-  g_printf ("%s", data);
+  dump_directory (client, dir, "/", &first_group);
 
   return TRUE;
 }
 
-static GKeyFile *
-keyfile_from_stdin (GError **error)
-{
-  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+typedef gboolean (*KeyFileForeachFunc) (const gchar  *path,
+                                        GVariant     *value,
+                                        gpointer      user_data,
+                                        GError      **error);
 
-  char buffer[1024];
+/**
+ * keyfile_entry_parse:
+ *
+ * Reconstruct dconf key path from the current dir, key-file group name and
+ * key-file key, and parse the value.
+ **/
+static gboolean
+keyfile_entry_parse (const gchar  *dir,
+                     const gchar  *group,
+                     const gchar  *key,
+                     const gchar  *value_str,
+                     gchar       **path,
+                     GVariant    **value,
+                     GError      **error)
+{
   g_autoptr(GString) s = NULL;
-  g_autoptr(GKeyFile) kf = NULL;
 
-  s = g_string_new (NULL);
-  while (fgets (buffer, sizeof (buffer), stdin) != NULL)
-    g_string_append (s, buffer);
+  s = g_string_new (dir);
+  if (strcmp (group, "/") != 0)
+    {
+      g_string_append (s, group);
+      g_string_append (s, "/");
+    }
+  g_string_append (s, key);
 
-  kf = g_key_file_new ();
-  if (!g_key_file_load_from_data (kf, s->str, s->len, G_KEY_FILE_NONE, error))
-    return FALSE;
+  if (!dconf_is_key (s->str, error))
+    {
+      g_prefix_error (error, "[%s]: %s: invalid path: ", group, key);
+      return FALSE;
+    }
 
-  return g_steal_pointer (&kf);
-}
+  *value = g_variant_parse (NULL, value_str, NULL, NULL, error);
+  if (*value == NULL)
+    {
+      g_prefix_error (error, "[%s]: %s: invalid value: %s: ",
+                      group, key, value_str);
+      return FALSE;
+    }
 
-typedef void (*KeyFileForeachFunc) (const gchar *path,
-                                    GVariant    *value,
-                                    gpointer     user_data);
+  *path = g_string_free (g_steal_pointer (&s), FALSE);
+
+  return TRUE;
+}
 
 static gboolean
 keyfile_foreach (GKeyFile           *kf,
@@ -539,55 +589,242 @@ keyfile_foreach (GKeyFile           *kf,
 
       for (gchar **key = keys; *key; ++key)
         {
-          g_autoptr(GString) s = NULL;
+          g_autofree gchar *path = NULL;
           g_autofree gchar *value_str = NULL;
           g_autoptr(GVariant) value = NULL;
 
-          /* Reconstruct dconf key path from the current dir,
-           * key-file group name and key-file key. */
-          s = g_string_new (dir);
-          if (strcmp (*group, "/") != 0)
-            {
-              g_string_append (s, *group);
-              g_string_append (s, "/");
-            }
-          g_string_append (s, *key);
-
-          if (!dconf_is_key (s->str, error))
-            {
-              g_prefix_error (error, "[%s]: %s: invalid path: ",
-                              *group, *key);
-              return FALSE;
-            }
-
           value_str = g_key_file_get_value (kf, *group, *key, NULL);
           g_assert (value_str != NULL);
 
-          value = g_variant_parse (NULL, value_str, NULL, NULL, error);
-          if (value == NULL)
+          if (!keyfile_entry_parse (dir, *group, *key, value_str,
+                                    &path, &value, error))
+            return FALSE;
+
+          if (!func (path, value, user_data, error))
+            return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+/**
+ * keyfile_read_line:
+ * @file: the file to read from
+ * @line: a #GString to hold the line
+ *
+ * Read a single line from @file, without the line terminator.
+ *
+ * Returns: %FALSE on end of file
+ **/
+static gboolean
+keyfile_read_line (FILE    *file,
+                   GString *line)
+{
+  char buffer[1024];
+
+  g_string_truncate (line, 0);
+
+  while (fgets (buffer, sizeof (buffer), file) != NULL)
+    {
+      g_string_append (line, buffer);
+
+      if (line->len > 0 && line->str[line->len - 1] == '\n')
+        {
+          g_string_truncate (line, line->len - 1);
+          return TRUE;
+        }
+    }
+
+  return line->len > 0;
+}
+
+/* As g_key_file_is_group_name() */
+static gboolean
+keyfile_is_group_name (const gchar *name)
+{
+  const gchar *p;
+
+  for (p = name; *p; p++)
+    if (*p == '[' || *p == ']' || g_ascii_iscntrl (*p))
+      return FALSE;
+
+  return p != name;
+}
+
+/* As g_key_file_is_key_name(), including the optional [locale] suffix */
+static gboolean
+keyfile_is_key_name (const gchar *key)
+{
+  const gchar *q;
+
+  for (q = key; *q && *q != '[' && *q != ']'; q++)
+    ;
+
+  if (q == key || key[0] == ' ' || q[-1] == ' ')
+    return FALSE;
+
+  if (*q == '[')
+    {
+      for (q++; *q; q = g_utf8_next_char (q))
+        {
+          gunichar c = g_utf8_get_char_validated (q, -1);
+
+          if (!g_unichar_isalnum (c) && c != '-' && c != '_' && c != '.' && c != '@')
+            break;
+        }
+
+      if (*q != ']')
+        return FALSE;
+
+      q++;
+    }
+
+  return *q == '\0';
+}
+
+/**
+ * keyfile_foreach_stream:
+ *
+ * Like keyfile_foreach(), but parses the key-file incrementally from @file
+ * instead of loading it into a #GKeyFile first.  Entries are passed to @func
+ * in file order as soon as they are read, so memory use is bounded by the
+ * length of the longest line rather than by the size of the input.
+ *
+ * The accepted syntax is the subset of the #GKeyFile format that dconf uses:
+ * empty lines, comments starting with '#', group headers and key-value pairs.
+ * Whitespace, group names and key names are handled as #GKeyFile does, so the
+ * same input is accepted as when it was loaded with g_key_file_load_from_data().
+ * The one exception is the special "Encoding" key of the first group, which is
+ * treated as an ordinary key here.
+ **/
+static gboolean
+keyfile_foreach_stream (FILE               *file,
+                        const gchar        *dir,
+                        KeyFileForeachFunc  func,
+                        gpointer            user_data,
+                        GError            **error)
+{
+  g_autoptr(GString) line = g_string_new (NULL);
+  g_autofree gchar *group = NULL;
+  guint lineno = 0;
+
+  while (keyfile_read_line (file, line))
+    {
+      g_autofree gchar *path = NULL;
+      g_autoptr(GVariant) value = NULL;
+      gchar *text, *eq, *end;
+
+      lineno++;
+
+      /* GKeyFile drops a '\r' before the line terminator and skips
+       * leading whitespace, but keeps any other trailing whitespace.
+       */
+      if (line->len > 0 && line->str[line->len - 1] == '\r')
+        g_string_truncate (line, line->len - 1);
+
+      for (text = line->str; g_ascii_isspace (*text); text++)
+        ;
+
+      if (text[0] == '\0' || text[0] == '#')
+        continue;
+
+      /* A group header may only be followed by spaces and tabs */
+      if (text[0] == '[' && (end = strchr (text, ']')) != NULL &&
+          end[1 + strspn (end + 1, " \t")] == '\0')
+        {
+          *end = '\0';
+
+          if (!keyfile_is_group_name (text + 1))
             {
-              g_prefix_error (error, "[%s]: %s: invalid value: %s: ",
-                              *group, *key, value_str);
+              g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_PARSE,
+                           "line %u: invalid group name: %s", lineno, text + 1);
               return FALSE;
             }
 
-          func (s->str, value, user_data);
+          g_free (group);
+          group = g_strdup (text + 1);
+          continue;
+        }
+
+      eq = strchr (text, '=');
+      if (eq == NULL || eq == text)
+        {
+          g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_PARSE,
+                       "line %u: not a key-value pair, group, or comment: %s",
+                       lineno, text);
+          return FALSE;
         }
+
+      if (group == NULL)
+        {
+          g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_GROUP_NOT_FOUND,
+                       "line %u: key-file does not start with a group", lineno);
+          return FALSE;
+        }
+
+      *eq = '\0';
+      g_strchomp (text);
+
+      if (!keyfile_is_key_name (text))
+        {
+          g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_PARSE,
+                       "line %u: invalid key name: %s", lineno, text);
+          return FALSE;
+        }
+
+      if (!keyfile_entry_parse (dir, group, text, g_strchug (eq + 1),
+                                &path, &value, error))
+        return FALSE;
+
+      if (!func (path, value, user_data, error))
+        return FALSE;
+    }
+
+  if (ferror (file))
+    {
+      gint saved_errno = errno;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                   "error reading input: %s", g_strerror (saved_errno));
+      return FALSE;
     }
 
   return TRUE;
 }
 
+/* Number of keys sent per change request by 'dconf load' without -a */
+#define LOAD_CHUNK_SIZE 1000
+
 typedef struct {
   DConfClient    *client;
   DConfChangeset *changeset;
   gboolean        force;
+  gboolean        atomic;
+  guint           n_pending;
 } LoadContext;
 
-static void
-changeset_set (const gchar *path,
-               GVariant    *value,
-               gpointer     user_data)
+static gboolean
+load_flush (LoadContext  *ctx,
+            GError      **error)
+{
+  g_autoptr(DConfChangeset) changeset = NULL;
+
+  if (ctx->n_pending == 0)
+    return TRUE;
+
+  changeset = g_steal_pointer (&ctx->changeset);
+  ctx->changeset = dconf_changeset_new ();
+  ctx->n_pending = 0;
+
+  return dconf_client_change_sync (ctx->client, changeset, NULL, NULL, error);
+}
+
+static gboolean
+changeset_set (const gchar  *path,
+               GVariant     *value,
+               gpointer      user_data,
+               GError      **error)
 {
   LoadContext *ctx = user_data;
 
@@ -597,10 +834,16 @@ changeset_set (const gchar *path,
   if (ctx->force && !dconf_client_is_writable (ctx->client, path))
     {
       g_fprintf (stderr, "warning: ignored non-writable key '%s'\n", path);
-      return;
+      return TRUE;
     }
 
   dconf_changeset_set (ctx->changeset, path, value);
+  ctx->n_pending++;
+
+  if (!ctx->atomic && ctx->n_pending >= LOAD_CHUNK_SIZE)
+    return load_flush (ctx, error);
+
+  return TRUE;
 }
 
 static gboolean
@@ -610,15 +853,19 @@ dconf_load (const gchar **argv,
   const gchar *dir;
   gint index = 0;
   gboolean force = FALSE;
+  gboolean atomic = FALSE;
+  gboolean success;
   g_autoptr(GError) local_error = NULL;
-  g_autoptr(GKeyFile) kf = NULL;
-  g_autoptr(DConfChangeset) changeset = NULL;
   g_autoptr (DConfClient) client = NULL;
 
-  if (argv[index] != NULL && strcmp (argv[index], "-f") == 0)
+  for (; argv[index] != NULL && argv[index][0] == '-'; index++)
     {
-      force = TRUE;
-      index += 1;
+      if (strcmp (argv[index], "-f") == 0)
+        force = TRUE;
+      else if (strcmp (argv[index], "-a") == 0)
+        atomic = TRUE;
+      else
+        return option_error_set (error, "unknown option");
     }
 
   dir = argv[index];
@@ -630,18 +877,25 @@ dconf_load (const gchar **argv,
   if (argv[index] != NULL)
     return option_error_set (error, "too many arguments");
 
-  kf = keyfile_from_stdin (error);
-  if (kf == NULL)
-    return FALSE;
-
   client = dconf_client_new ();
-  changeset = dconf_changeset_new ();
 
-  LoadContext ctx = { client, changeset, force };
-  if (!keyfile_foreach (kf, dir, changeset_set, &ctx, error))
-    return FALSE;
+  /* By default the changes are sent in chunks of LOAD_CHUNK_SIZE keys as
+   * the input is read, which keeps both client and service memory bounded
+   * and each message well below the D-Bus size limit.  Each chunk is its
+   * own transaction, so an invalid line or a locked key leaves the chunks
+   * before it applied.
+   *
+   * With -a the entire input is validated and collected into a single
+   * changeset, which the service applies as one transaction: either all
+   * of the keys are changed or none, at the cost of holding everything in
+   * memory at once.
+   */
+  LoadContext ctx = { client, dconf_changeset_new (), force, atomic, 0 };
+  success = keyfile_foreach_stream (stdin, dir, changeset_set, &ctx, error) &&
+            load_flush (&ctx, error);
+  dconf_changeset_unref (ctx.changeset);
 
-  return dconf_client_change_sync (client, changeset, NULL, NULL, error);
+  return success;
 }
 
 static GPtrArray *
@@ -689,6 +943,7 @@ list_directory (const gchar *dirname,
 
 static GHashTable *
 read_locks_directory (const gchar  *dirname,
+                      GChecksum    *checksum,
                       GError      **error)
 {
   g_autoptr(GError) local_error = NULL;
@@ -706,6 +961,9 @@ read_locks_directory (const gchar  *dirname,
 
   table = gvdb_hash_table_new (NULL, NULL);
 
+  /* Sorted so that the checksum does not depend on the directory order. */
+  g_ptr_array_sort (files, string_compare);
+
   for (guint i = 0; i != files->len; ++i)
     {
       const gchar *filename;
@@ -718,6 +976,15 @@ read_locks_directory (const gchar  *dirname,
       if (!g_file_get_contents (filename, &contents, &length, error))
         return NULL;
 
+      if (checksum != NULL)
+        {
+          g_autofree gchar *basename = g_path_get_basename (filename);
+
+          g_checksum_update (checksum, (const guchar *) basename, strlen (basename) + 1);
+          g_checksum_update (checksum, (const guchar *) contents, length);
+          g_checksum_update (checksum, (const guchar *) "", 1);
+        }
+
       lines = g_strsplit (contents, "\n", 0);
       for (gchar **line = lines; *line; ++line)
         {
@@ -749,35 +1016,112 @@ table_get_parent (GHashTable  *table,
 }
 
 
-static void
-table_insert (const gchar *path,
-              GVariant    *value,
-              gpointer     user_data)
+static gboolean
+table_insert (const gchar  *path,
+              GVariant     *value,
+              gpointer      user_data,
+              GError      **error)
 {
   GHashTable *table = user_data;
   GvdbItem *item;
 
   /* See FILES-PRECEDENCE 2 */
   if (g_hash_table_lookup (table, path) != NULL)
-    return;
+    return TRUE;
 
   item = gvdb_hash_table_insert (table, path);
   gvdb_item_set_parent (item, table_get_parent (table, path));
   gvdb_item_set_value (item, value);
+
+  return TRUE;
 }
 
-static GHashTable *
-read_directory (const gchar  *dir,
-                GError      **error)
+typedef struct {
+  gchar    *filename;
+  GKeyFile *keyfile;
+  gchar    *checksum;
+  GError   *error;
+} KeyFileJob;
+
+static void
+keyfile_job_free (gpointer data)
 {
-  g_autoptr(GError) local_error = NULL;
-  g_autoptr(GHashTable) table = NULL;
-  g_autoptr(GPtrArray) files = NULL;
-  g_autofree gchar *locks_dir = NULL;
-  GHashTable *locks_table = NULL;
+  KeyFileJob *job = data;
 
-  table = gvdb_hash_table_new (NULL, NULL);
-  gvdb_hash_table_insert (table, "/");
+  g_free (job->filename);
+  g_free (job->checksum);
+  g_clear_pointer (&job->keyfile, g_key_file_unref);
+  g_clear_error (&job->error);
+  g_slice_free (KeyFileJob, job);
+}
+
+static void
+keyfile_job_run (gpointer data,
+                 gpointer user_data)
+{
+  KeyFileJob *job = data;
+  g_autofree gchar *contents = NULL;
+  gsize length;
+
+  g_debug ("loading key-file: %s", job->filename);
+
+  if (!g_file_get_contents (job->filename, &contents, &length, &job->error))
+    return;
+
+  job->checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+                                               (const guchar *) contents, length);
+
+  job->keyfile = g_key_file_new ();
+  if (!g_key_file_load_from_data (job->keyfile, contents, length,
+                                  G_KEY_FILE_NONE, &job->error))
+    g_clear_pointer (&job->keyfile, g_key_file_unref);
+}
+
+/**
+ * run_jobs:
+ * @jobs: the jobs to run
+ * @func: the function to run for each of @jobs
+ * @n_jobs: the maximum number of jobs to run at the same time
+ *
+ * Run @func on each item of @jobs, using up to @n_jobs threads, and wait
+ * for all of them to complete.  The jobs must be independent of each
+ * other; each one stores its own result so that the caller can consume
+ * the results in order afterwards.
+ **/
+static void
+run_jobs (GPtrArray *jobs,
+          GFunc      func,
+          guint      n_jobs)
+{
+  GThreadPool *pool;
+
+  if (n_jobs <= 1 || jobs->len <= 1)
+    {
+      g_ptr_array_foreach (jobs, func, NULL);
+      return;
+    }
+
+  pool = g_thread_pool_new (func, NULL, MIN (n_jobs, jobs->len), FALSE, NULL);
+
+  for (guint i = 0; i != jobs->len; ++i)
+    g_thread_pool_push (pool, g_ptr_array_index (jobs, i), NULL);
+
+  g_thread_pool_free (pool, FALSE, TRUE);
+}
+
+/**
+ * list_keyfiles:
+ * @dir: a key-file .d directory
+ *
+ * Returns a #KeyFileJob for each key-file in @dir, in the order in which
+ * their contents must be merged.
+ **/
+static GPtrArray *
+list_keyfiles (const gchar  *dir,
+               GError      **error)
+{
+  g_autoptr(GPtrArray) files = NULL;
+  g_autoptr(GPtrArray) jobs = NULL;
 
   files = list_directory (dir, S_IFREG, error);
   if (files == NULL)
@@ -790,37 +1134,76 @@ read_directory (const gchar  *dir,
    */
   g_ptr_array_sort (files, string_rcompare);
 
+  jobs = g_ptr_array_new_full (files->len, keyfile_job_free);
+
   for (guint i = 0; i != files->len; ++i)
     {
-      const gchar *filename;
-      g_autoptr(GKeyFile) kf = NULL;
+      KeyFileJob *job = g_slice_new0 (KeyFileJob);
 
-      filename = g_ptr_array_index (files, i);
-      kf = g_key_file_new ();
+      job->filename = g_strdup (g_ptr_array_index (files, i));
+      g_ptr_array_add (jobs, job);
+    }
+
+  return g_steal_pointer (&jobs);
+}
+
+/**
+ * table_from_keyfiles:
+ * @dir: a key-file .d directory
+ * @keyfiles: the result of list_keyfiles() for @dir, after the jobs ran
+ * @checksum: (nullable): a #GChecksum to feed the inputs to
+ *
+ * Merges the parsed key-files and the locks of @dir into a gvdb table.
+ * This is done serially, in the order of @keyfiles, so the result does
+ * not depend on the order in which the key-files were parsed.
+ *
+ * If @checksum is given, the names and contents of all of the inputs are
+ * added to it, so that it identifies the resulting database.
+ **/
+static GHashTable *
+table_from_keyfiles (const gchar  *dir,
+                     GPtrArray    *keyfiles,
+                     GChecksum    *checksum,
+                     GError      **error)
+{
+  g_autoptr(GError) local_error = NULL;
+  g_autoptr(GHashTable) table = NULL;
+  g_autofree gchar *locks_dir = NULL;
+  GHashTable *locks_table = NULL;
+
+  table = gvdb_hash_table_new (NULL, NULL);
+  gvdb_hash_table_insert (table, "/");
 
-      g_debug ("loading key-file: %s", filename);
+  for (guint i = 0; i != keyfiles->len; ++i)
+    {
+      KeyFileJob *job = g_ptr_array_index (keyfiles, i);
 
-      if (!g_key_file_load_from_file (kf, filename, G_KEY_FILE_NONE, error))
+      if (job->error != NULL ||
+          !keyfile_foreach (job->keyfile, "/", table_insert, table, error))
         {
-          g_autofree gchar *display_name = g_filename_display_basename (filename);
+          g_autofree gchar *display_name = g_filename_display_basename (job->filename);
+
+          if (job->error != NULL)
+            g_propagate_error (error, g_steal_pointer (&job->error));
           g_prefix_error (error, "%s: ", display_name);
-          return FALSE;
+          return NULL;
         }
 
-      if (!keyfile_foreach (kf, "/", table_insert, table, error))
+      if (checksum != NULL)
         {
-          g_autofree gchar *display_name = g_filename_display_basename (filename);
-          g_prefix_error (error, "%s: ", display_name);
-          return FALSE;
+          g_autofree gchar *basename = g_path_get_basename (job->filename);
+
+          g_checksum_update (checksum, (const guchar *) basename, strlen (basename) + 1);
+          g_checksum_update (checksum, (const guchar *) job->checksum, strlen (job->checksum) + 1);
         }
     }
 
   locks_dir = g_build_filename (dir, "locks", NULL);
-  locks_table = read_locks_directory (locks_dir, &local_error);
+  locks_table = read_locks_directory (locks_dir, checksum, &local_error);
   if (local_error != NULL)
     {
       g_propagate_error (error, g_steal_pointer (&local_error));
-      return FALSE;
+      return NULL;
     }
 
   if (locks_table != NULL)
@@ -834,21 +1217,28 @@ read_directory (const gchar  *dir,
   return g_steal_pointer (&table);
 }
 
-static gboolean
-update_directory (const gchar *dir,
-                  GError     **error)
+static GHashTable *
+read_directory (const gchar  *dir,
+                guint         n_jobs,
+                GError      **error)
 {
-  gint fd = -1;
-  g_autofree gchar *filename = NULL;
-  g_autoptr(GHashTable) table = NULL;
-  g_autoptr(GDBusConnection) bus = NULL;
+  g_autoptr(GPtrArray) keyfiles = NULL;
 
-  g_assert (g_str_has_suffix (dir, ".d"));
-  filename = strndup (dir, strlen (dir) - 2);
+  keyfiles = list_keyfiles (dir, error);
+  if (keyfiles == NULL)
+    return NULL;
 
-  table = read_directory (dir, error);
-  if (table == NULL)
-    return FALSE;
+  run_jobs (keyfiles, keyfile_job_run, n_jobs);
+
+  return table_from_keyfiles (dir, keyfiles, NULL, error);
+}
+
+static gboolean
+write_database (const gchar  *filename,
+                GHashTable   *table,
+                GError      **error)
+{
+  gint fd = -1;
 
   fd = open (filename, O_WRONLY);
   if (fd < 0 && errno != ENOENT)
@@ -860,6 +1250,10 @@ update_directory (const gchar *dir,
                  display_name, g_strerror (saved_errno));
     }
 
+  /* No inline values here: processes still running an older libdconf
+   * reopen system databases when they are replaced, and would not find
+   * them.
+   */
   if (!gvdb_table_write_contents (table, filename, FALSE, error))
     {
       if (fd >= 0)
@@ -874,57 +1268,198 @@ update_directory (const gchar *dir,
       close (fd);
     }
 
-  bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, NULL);
+  return TRUE;
+}
 
-  if (bus != NULL)
+static void
+notify_database (GDBusConnection *bus,
+                 const gchar     *filename)
+{
+  g_autofree gchar *object_name = NULL;
+  g_autofree gchar *object_path = NULL;
+
+  object_name = g_path_get_basename (filename);
+  object_path = g_strconcat ("/ca/desrt/dconf/Writer/", object_name, NULL);
+
+  /* Ignore all D-Bus errors. */
+  g_dbus_connection_emit_signal (bus, NULL, object_path,
+                                 "ca.desrt.dconf.Writer",
+                                 "WritabilityNotify",
+                                  g_variant_new ("(s)", "/"),
+                                  NULL);
+}
+
+/* Bump when the database produced from the same inputs changes, to make
+ * sure that 'dconf update' rewrites the existing databases.
+ */
+#define UPDATE_DIGEST_VERSION "dconf-update-4"
+
+/**
+ * database_is_up_to_date:
+ * @filename: the database file
+ * @digest: the digest of the inputs of the new database
+ *
+ * Checks if @filename is a valid database that was produced from inputs
+ * with the given @digest, as recorded under the ".digest" name by
+ * database_job_run().
+ **/
+static gboolean
+database_is_up_to_date (const gchar *filename,
+                        const gchar *digest)
+{
+  g_autoptr(GVariant) value = NULL;
+  GvdbTable *table;
+
+  table = gvdb_table_new (filename, FALSE, NULL);
+  if (table == NULL)
+    return FALSE;
+
+  value = gvdb_table_get_value (table, ".digest");
+  gvdb_table_free (table);
+
+  return value != NULL &&
+         g_variant_is_of_type (value, G_VARIANT_TYPE_STRING) &&
+         g_str_equal (g_variant_get_string (value, NULL), digest);
+}
+
+typedef struct {
+  gchar     *dir;
+  gchar     *filename;
+  GPtrArray *keyfiles;
+  gboolean   unchanged;
+  GError    *error;
+} DatabaseJob;
+
+static void
+database_job_free (gpointer data)
+{
+  DatabaseJob *job = data;
+
+  g_free (job->dir);
+  g_free (job->filename);
+  g_clear_pointer (&job->keyfiles, g_ptr_array_unref);
+  g_clear_error (&job->error);
+  g_slice_free (DatabaseJob, job);
+}
+
+static void
+database_job_run (gpointer data,
+                  gpointer user_data)
+{
+  DatabaseJob *job = data;
+  g_autoptr(GHashTable) table = NULL;
+  g_autoptr(GChecksum) checksum = NULL;
+  const gchar *digest;
+
+  if (job->error != NULL)
+    return;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (checksum, (const guchar *) UPDATE_DIGEST_VERSION, -1);
+
+  table = table_from_keyfiles (job->dir, job->keyfiles, checksum, &job->error);
+  if (table == NULL)
+    return;
+
+  /* Rewriting the database makes every client reopen it, so don't do it
+   * unless the inputs have actually changed.
+   */
+  digest = g_checksum_get_string (checksum);
+  if (database_is_up_to_date (job->filename, digest))
     {
-      g_autofree gchar *object_name = NULL;
-      g_autofree gchar *object_path = NULL;
-
-      object_name = g_path_get_basename (filename);
-      object_path = g_strconcat ("/ca/desrt/dconf/Writer/", object_name, NULL);
-
-      /* Ignore all D-Bus errors. */
-      g_dbus_connection_emit_signal (bus, NULL, object_path,
-                                     "ca.desrt.dconf.Writer",
-                                     "WritabilityNotify",
-                                      g_variant_new ("(s)", "/"),
-                                      NULL);
-      g_dbus_connection_flush_sync (bus, NULL, NULL);
+      g_debug ("database %s is up to date", job->filename);
+      job->unchanged = TRUE;
+      return;
     }
 
-  return TRUE;
+  gvdb_hash_table_insert_string (table, ".digest", digest);
+
+  write_database (job->filename, table, &job->error);
 }
 
+/**
+ * update_all:
+ * @dirname: the databases directory
+ * @n_jobs: the number of threads to use
+ *
+ * Compiles each of the .d directories in @dirname into a database.
+ *
+ * This is done in phases so that no job ever waits for another: first all
+ * key-files of all databases are parsed, then the databases are merged and
+ * written, each using as many threads as allowed.  Reporting errors and
+ * notifying the clients is done serially, in order, at the end.  Since
+ * merging is ordered within each database, the output does not depend on
+ * @n_jobs.
+ *
+ * Databases whose inputs did not change since they were last written are
+ * left alone and no notification is sent for them.
+ **/
 static gboolean
 update_all (const gchar *dirname,
+            guint        n_jobs,
             GError     **error)
 {
   gboolean failed = FALSE;
   g_autoptr(GPtrArray) files = NULL;
+  g_autoptr(GPtrArray) databases = NULL;
+  g_autoptr(GPtrArray) keyfiles = NULL;
+  g_autoptr(GDBusConnection) bus = NULL;
 
   files = list_directory (dirname, S_IFDIR, error);
   if (files == NULL)
     return FALSE;
 
+  databases = g_ptr_array_new_with_free_func (database_job_free);
+  keyfiles = g_ptr_array_new ();
+
   for (guint i = 0; i != files->len; ++i)
     {
       const gchar *name;
-      g_autoptr(GError) local_error = NULL;
+      DatabaseJob *job;
 
       name = g_ptr_array_index (files, i);
       if (!g_str_has_suffix (name, ".d"))
         continue;
 
-      if (!update_directory (name, &local_error))
+      job = g_slice_new0 (DatabaseJob);
+      job->dir = g_strdup (name);
+      job->filename = g_strndup (name, strlen (name) - 2);
+      job->keyfiles = list_keyfiles (name, &job->error);
+      g_ptr_array_add (databases, job);
+
+      if (job->keyfiles != NULL)
+        g_ptr_array_extend (keyfiles, job->keyfiles, NULL, NULL);
+    }
+
+  run_jobs (keyfiles, keyfile_job_run, n_jobs);
+  run_jobs (databases, database_job_run, n_jobs);
+
+  for (guint i = 0; i != databases->len; ++i)
+    {
+      DatabaseJob *job = g_ptr_array_index (databases, i);
+
+      if (job->error != NULL)
         {
-          g_autofree gchar *display_name = g_filename_display_name (name);
+          g_autofree gchar *display_name = g_filename_display_name (job->dir);
           g_fprintf (stderr, "%s: %s\n",
-                     display_name, local_error->message);
+                     display_name, job->error->message);
           failed = TRUE;
+          continue;
         }
+
+      if (job->unchanged)
+        continue;
+
+      if (bus == NULL)
+        bus = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, NULL);
+
+      if (bus != NULL)
+        notify_database (bus, job->filename);
     }
 
+  if (bus != NULL)
+    g_dbus_connection_flush_sync (bus, NULL, NULL);
+
   if (failed)
     {
       g_set_error_literal (error, DCONF_ERROR, DCONF_ERROR_FAILED,
@@ -939,11 +1474,18 @@ static gboolean
 dconf_compile (const gchar **argv,
                GError      **error)
 {
+  GvdbWriteFlags flags = GVDB_WRITE_FLAGS_NONE;
   gboolean byteswap;
   const gchar *output;
   const gchar *dir;
   g_autoptr(GHashTable) table = NULL;
 
+  if (argv[0] != NULL && strcmp (argv[0], "-i") == 0)
+    {
+      flags |= GVDB_WRITE_FLAGS_INLINE_VALUES;
+      argv++;
+    }
+
   output = argv[0];
   if (output == NULL)
     return option_error_set (error, "output file not specified");
@@ -955,14 +1497,14 @@ dconf_compile (const gchar **argv,
   if (argv[2] != NULL)
     return option_error_set (error, "too many arguments");
 
-  table = read_directory (dir, error);
+  table = read_directory (dir, g_get_num_processors (), error);
   if (table == NULL)
     return FALSE;
 
   /* We always write the result of "dconf compile" as little endian so
    * that it can be installed in /usr/share */
   byteswap = (G_BYTE_ORDER == G_BIG_ENDIAN);
-  return gvdb_table_write_contents (table, output, byteswap, error);
+  return gvdb_table_write_contents_with_flags (table, output, byteswap, flags, error);
 }
 
 static gchar *
@@ -976,11 +1518,26 @@ dconf_update (const gchar **argv,
               GError      **error)
 {
   gint index = 0;
+  guint n_jobs = g_get_num_processors ();
   g_autofree gchar *dir = NULL;
 
+  if (argv[index] != NULL && strcmp (argv[index], "-j") == 0)
+    {
+      guint64 value;
+
+      index += 1;
+
+      if (argv[index] == NULL ||
+          !g_ascii_string_to_unsigned (argv[index], 10, 1, G_MAXUINT, &value, NULL))
+        return option_error_set (error, "-j requires a positive number of jobs");
+
+      n_jobs = value;
+      index += 1;
+    }
+
   if (argv[index] != NULL)
     {
-      dir = g_strdup (argv[0]);
+      dir = g_strdup (argv[index]);
       index += 1;
     }
   else
@@ -989,7 +1546,7 @@ dconf_update (const gchar **argv,
   if (argv[index] != NULL)
     return option_error_set (error, "too many arguments");
 
-  return update_all (dir, error);
+  return update_all (dir, n_jobs, error);
 }
 
 typedef struct {
@@ -1031,13 +1588,13 @@ static const Command commands[] = {
   },
   {
     "compile", dconf_compile,
-    "Compile a binary database from keyfiles",
-    " OUTPUT KEYFILEDIR "
+    "Compile a binary database from keyfiles.  -i store small values inline.",
+    " [-i] OUTPUT KEYFILEDIR "
   },
   {
     "update", dconf_update,
-    "Update the system dconf databases",
-    " [DBDIR] "
+    "Update the system dconf databases.  -j number of parallel jobs.",
+    " [-j N] [DBDIR] "
   },
   {
     "watch", dconf_watch,
@@ -1051,8 +1608,8 @@ static const Command commands[] = {
   },
   {
     "load", dconf_load, 
-    "Populate a subpath from stdin.  -f ignore locked keys.",
-    " [-f] DIR "
+    "Populate a subpath from stdin, in chunks.  -f ignore locked keys, -a all or nothing.",
+    " [-f] [-a] DIR "
   },
   {
     "blame", dconf_blame,
@@ -1149,6 +1706,9 @@ command_show_help (const Command *cmd,
           if (strstr (cmd->synopsis, " SUFFIX ") != NULL)
             g_string_append (s, "  SUFFIX      An empty string '' or '/'.\n");
 
+          if (strstr (cmd->synopsis, " [-j N] ") != NULL)
+            g_string_append (s, "  N           The number of jobs to run in parallel. Default: number of CPUs\n");
+
           if (strstr (cmd->synopsis, " [DBDIR] ") != NULL)
             {
               g_autofree gchar *path = get_system_db_path ();
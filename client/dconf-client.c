@@ -336,6 +336,42 @@ dconf_client_read_full (DConfClient    *client,
   return dconf_engine_read (client->engine, flags, read_through, key);
 }
 
+/**
+ * dconf_client_read_many:
+ * @client: a #DConfClient
+ * @keys: a %NULL-terminated array of keys to read
+ * @flags: #DConfReadFlags
+ * @read_through: a #GQueue of #DConfChangeset
+ *
+ * Reads the current values of each of @keys.
+ *
+ * This is equivalent to calling dconf_client_read_full() for each key,
+ * but is more efficient for a large number of keys since the databases
+ * are only consulted once for the entire batch.  The values are read
+ * together, at one point in time.
+ *
+ * The result is an array containing one item for each of @keys, in
+ * order.  Each item is a #GVariant, or %NULL if the key has no value.
+ * The array is not %NULL-terminated.  Free each non-%NULL item with
+ * g_variant_unref() and the array itself with g_free().
+ *
+ * Returns: (transfer full) (array) (element-type GVariant) (nullable):
+ *   an array of #GVariant (or %NULL), of the same length as @keys
+ *
+ * Since: 0.42
+ */
+GVariant **
+dconf_client_read_many (DConfClient         *client,
+                        const gchar * const *keys,
+                        DConfReadFlags       flags,
+                        const GQueue        *read_through)
+{
+  g_return_val_if_fail (DCONF_IS_CLIENT (client), NULL);
+  g_return_val_if_fail (keys != NULL, NULL);
+
+  return dconf_engine_read_many (client->engine, flags, read_through, keys, g_strv_length ((gchar **) keys));
+}
+
 /**
  * dconf_client_list:
  * @client: a #DConfClient
@@ -583,6 +619,120 @@ dconf_client_change_sync (DConfClient     *client,
   return dconf_engine_change_sync (client->engine, changeset, tag, error);
 }
 
+static void
+dconf_client_change_async_done (DConfEngine  *engine,
+                                const gchar  *tag,
+                                const GError *error,
+                                gpointer      user_data)
+{
+  GTask *task = user_data;
+
+  if (error)
+    g_task_return_error (task, g_error_copy (error));
+  else
+    g_task_return_pointer (task, g_strdup (tag), g_free);
+
+  g_object_unref (task);
+}
+
+/**
+ * dconf_client_change_async:
+ * @client: a #DConfClient
+ * @changeset: the changeset describing the requested change
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: (scope async): the function to call when the change is complete
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronously performs the change operation described by
+ * @changeset.
+ *
+ * Once @changeset is passed to this call it can no longer be modified.
+ *
+ * The request is sent to the service immediately and @callback is
+ * invoked in the thread-default main context of the caller once the
+ * service has confirmed (or refused) the write.  Call
+ * dconf_client_change_finish() from @callback to find out the result.
+ *
+ * Unlike dconf_client_change_fast(), no change signal is emitted
+ * until the service reports the change, and unlike
+ * dconf_client_change_sync(), the calling thread is not blocked.  Any
+ * number of asynchronous changes may be outstanding at the same time.
+ *
+ * Cancelling @cancellable only changes the reported result: @callback
+ * is still invoked once the service replies, and the operation then
+ * reports %G_IO_ERROR_CANCELLED.  A request that was already sent can
+ * not be taken back, so the change may have been applied anyway.
+ *
+ * Since: 0.42
+ **/
+void
+dconf_client_change_async (DConfClient         *client,
+                           DConfChangeset      *changeset,
+                           GCancellable        *cancellable,
+                           GAsyncReadyCallback  callback,
+                           gpointer             user_data)
+{
+  GError *error = NULL;
+  GTask *task;
+
+  g_return_if_fail (DCONF_IS_CLIENT (client));
+
+  task = g_task_new (client, cancellable, callback, user_data);
+  g_task_set_source_tag (task, dconf_client_change_async);
+
+  /* The engine holds a reference until it calls us back */
+  if (!dconf_engine_change_async (client->engine, changeset,
+                                  dconf_client_change_async_done,
+                                  g_object_ref (task), &error))
+    {
+      g_task_return_error (task, error);
+      g_object_unref (task);
+    }
+
+  g_object_unref (task);
+}
+
+/**
+ * dconf_client_change_finish:
+ * @client: a #DConfClient
+ * @result: the #GAsyncResult passed to the callback
+ * @tag: (out) (optional) (not nullable) (transfer full): the tag from this write
+ * @error: a pointer to a %NULL #GError, or %NULL
+ *
+ * Completes a call to dconf_client_change_async().
+ *
+ * If @tag is non-%NULL then it is set to the unique tag associated with
+ * this change, as with dconf_client_change_sync().
+ *
+ * Returns: %TRUE on success, else %FALSE with @error set
+ *
+ * Since: 0.42
+ **/
+gboolean
+dconf_client_change_finish (DConfClient   *client,
+                            GAsyncResult  *result,
+                            gchar        **tag,
+                            GError       **error)
+{
+  gchar *result_tag;
+
+  g_return_val_if_fail (DCONF_IS_CLIENT (client), FALSE);
+  g_return_val_if_fail (g_task_is_valid (result, client), FALSE);
+  g_return_val_if_fail (g_task_get_source_tag (G_TASK (result)) == dconf_client_change_async, FALSE);
+
+  result_tag = g_task_propagate_pointer (G_TASK (result), error);
+
+  if (result_tag == NULL)
+    return FALSE;
+
+  if (tag)
+    *tag = result_tag;
+  else
+    g_free (result_tag);
+
+  return TRUE;
+}
+
 /**
  * dconf_client_watch_fast:
  * @client: a #DConfClient
@@ -695,3 +845,36 @@ dconf_client_sync (DConfClient *client)
 
   dconf_engine_sync (client->engine);
 }
+
+/**
+ * dconf_client_get_read_cache_stats:
+ * @client: a #DConfClient
+ * @hits: (out) (optional): return location for the number of cache hits
+ * @misses: (out) (optional): return location for the number of cache misses
+ *
+ * Gets the number of reads that were answered from the read cache of
+ * @client, and the number that had to consult the databases.
+ *
+ * The read cache is disabled unless the DCONF_READ_CACHE_SIZE
+ * environment variable is set to the maximum number of values to
+ * keep, in which case both counts are always zero.
+ *
+ * Since: 0.42
+ **/
+void
+dconf_client_get_read_cache_stats (DConfClient *client,
+                                   guint64     *hits,
+                                   guint64     *misses)
+{
+  guint64 my_hits, my_misses;
+
+  g_return_if_fail (DCONF_IS_CLIENT (client));
+
+  dconf_engine_get_read_cache_stats (client->engine, &my_hits, &my_misses);
+
+  if (hits)
+    *hits = my_hits;
+
+  if (misses)
+    *misses = my_misses;
+}
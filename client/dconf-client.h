@@ -39,6 +39,11 @@ GVariant *              dconf_client_read_full                          (DConfCl
                                                                          DConfReadFlags        flags,
                                                                          const GQueue         *read_through);
 
+GVariant **             dconf_client_read_many                          (DConfClient          *client,
+                                                                         const gchar * const  *keys,
+                                                                         DConfReadFlags        flags,
+                                                                         const GQueue         *read_through);
+
 gchar **                dconf_client_list                               (DConfClient          *client,
                                                                          const gchar          *dir,
                                                                          gint                 *length);
@@ -69,6 +74,15 @@ gboolean                dconf_client_change_sync                        (DConfCl
                                                                          gchar               **tag,
                                                                          GCancellable         *cancellable,
                                                                          GError              **error);
+void                    dconf_client_change_async                       (DConfClient          *client,
+                                                                         DConfChangeset       *changeset,
+                                                                         GCancellable         *cancellable,
+                                                                         GAsyncReadyCallback   callback,
+                                                                         gpointer              user_data);
+gboolean                dconf_client_change_finish                      (DConfClient          *client,
+                                                                         GAsyncResult         *result,
+                                                                         gchar               **tag,
+                                                                         GError              **error);
 
 void                    dconf_client_watch_fast                         (DConfClient          *client,
                                                                          const gchar          *path);
@@ -82,6 +96,10 @@ void                    dconf_client_unwatch_sync                       (DConfCl
 
 void                    dconf_client_sync                               (DConfClient          *client);
 
+void                    dconf_client_get_read_cache_stats               (DConfClient          *client,
+                                                                         guint64              *hits,
+                                                                         guint64              *misses);
+
 
 G_END_DECLS
 
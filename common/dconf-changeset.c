@@ -51,10 +51,51 @@
  * references.
  **/
 
+typedef struct _DConfChangesetDir DConfChangesetDir;
+
+/* A node in the index of dirs, used for prefix operations.
+ *
+ * There is a node for each dir that is reset by the changeset or that
+ * contains (directly or in a subdir) a key in the changeset.  Nodes are
+ * removed again as soon as they become empty.
+ */
+struct _DConfChangesetDir
+{
+  DConfChangesetDir *parent;
+  gchar *path;              /* also the key in the 'dirs' table */
+  GHashTable *subdirs;      /* set of DConfChangesetDir, or NULL */
+  GHashTable *keys;         /* set of keys, owned by 'table', or NULL */
+  gboolean is_reset;        /* this dir is itself in 'table' */
+};
+
+/* An immutable database table, shared between database-mode
+ * changesets that were copied from one another.  The index of its dirs
+ * goes along with it, so that prefix operations on a copy don't need
+ * to flatten it.
+ */
+typedef struct
+{
+  GHashTable *table;
+  GHashTable *dirs;         /* index of 'table', built on first use */
+  gint ref_count;
+} DConfChangesetSnapshot;
+
 struct _DConfChangeset
 {
   GHashTable *table;
-  GHashTable *dir_resets;
+  GHashTable *dirs;         /* index of 'table' only, not of 'snapshot' */
+
+  /* Database mode only.  If this is set then 'table' only holds the
+   * differences from the snapshot, with NULL for removed keys.
+   */
+  DConfChangesetSnapshot *snapshot;
+
+  /* If this is set then the keys in 'table' point into it, rather than
+   * being owned by the table.  See dconf_changeset_deserialise().
+   */
+  GVariant *serialised;
+
+  guint n_dir_resets;
   guint is_database : 1;
   guint is_sealed : 1;
   gint ref_count;
@@ -71,6 +112,579 @@ unref_gvariant0 (gpointer data)
     g_variant_unref (data);
 }
 
+static GHashTable *
+dconf_changeset_table_new (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal, g_free, unref_gvariant0);
+}
+
+static void
+dconf_changeset_snapshot_unref (DConfChangesetSnapshot *snapshot)
+{
+  if (g_atomic_int_dec_and_test (&snapshot->ref_count))
+    {
+      if (snapshot->dirs)
+        g_hash_table_unref (snapshot->dirs);
+      g_hash_table_unref (snapshot->table);
+      g_slice_free (DConfChangesetSnapshot, snapshot);
+    }
+}
+
+static void dconf_changeset_index_add    (GHashTable  *dirs,
+                                         const gchar *path);
+static void dconf_changeset_index_remove (GHashTable  *dirs,
+                                         const gchar *path);
+
+/* Merges the snapshot (if any) back into the table, so that the table
+ * holds the entire contents of the database again.
+ *
+ * This is O(changes) if nobody else is using the snapshot any more, and
+ * the index of the snapshot (if it has one) is kept up to date as well.
+ * Otherwise the snapshot has to be copied and the index is rebuilt the
+ * next time it is needed.
+ */
+static void
+dconf_changeset_flatten (DConfChangeset *changeset)
+{
+  DConfChangesetSnapshot *snapshot = changeset->snapshot;
+  GHashTableIter iter;
+  gpointer key, value;
+  GHashTable *table;
+  GHashTable *dirs;
+
+  if (snapshot == NULL)
+    return;
+
+  if (g_atomic_int_get (&snapshot->ref_count) == 1)
+    {
+      table = g_hash_table_ref (snapshot->table);
+      dirs = g_steal_pointer (&snapshot->dirs);
+    }
+  else
+    {
+      table = dconf_changeset_table_new ();
+      dirs = NULL;
+
+      g_hash_table_iter_init (&iter, snapshot->table);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        g_hash_table_insert (table, g_strdup (key), g_variant_ref (value));
+    }
+
+  g_hash_table_iter_init (&iter, changeset->table);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      if (value != NULL)
+        {
+          gchar *copy = g_strdup (key);
+
+          if (g_hash_table_insert (table, copy, g_variant_ref (value)) && dirs)
+            dconf_changeset_index_add (dirs, copy);
+        }
+      else
+        {
+          if (dirs && g_hash_table_contains (table, key))
+            dconf_changeset_index_remove (dirs, key);
+
+          g_hash_table_remove (table, key);
+        }
+    }
+
+  /* The old index refers to the keys of the old table */
+  g_clear_pointer (&changeset->dirs, g_hash_table_unref);
+  changeset->dirs = dirs;
+
+  g_hash_table_unref (changeset->table);
+  changeset->table = table;
+
+  dconf_changeset_snapshot_unref (snapshot);
+  changeset->snapshot = NULL;
+}
+
+/* Returns a new reference to a snapshot holding the contents of
+ * @changeset (which must be an unsealed database), creating one if
+ * needed.
+ */
+static DConfChangesetSnapshot *
+dconf_changeset_share (DConfChangeset *changeset)
+{
+  /* Keep the differences small: if nobody else is using our snapshot
+   * then this is cheap.
+   */
+  if (changeset->snapshot && g_atomic_int_get (&changeset->snapshot->ref_count) == 1)
+    dconf_changeset_flatten (changeset);
+
+  if (changeset->snapshot == NULL)
+    {
+      changeset->snapshot = g_slice_new (DConfChangesetSnapshot);
+      changeset->snapshot->table = changeset->table;
+      changeset->snapshot->ref_count = 1;
+      changeset->table = dconf_changeset_table_new ();
+
+      /* The index refers to the keys of the old table, so it moves into
+       * the snapshot along with them.
+       */
+      changeset->snapshot->dirs = g_steal_pointer (&changeset->dirs);
+    }
+
+  g_atomic_int_inc (&changeset->snapshot->ref_count);
+
+  return changeset->snapshot;
+}
+
+/* Gives the table its own copy of any keys that were borrowed from a
+ * serialised changeset, so that it can be modified.
+ */
+static void
+dconf_changeset_own_keys (DConfChangeset *changeset)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  GHashTable *table;
+
+  if (changeset->serialised == NULL)
+    return;
+
+  table = dconf_changeset_table_new ();
+
+  g_hash_table_iter_init (&iter, changeset->table);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    g_hash_table_insert (table, g_strdup (key), value ? g_variant_ref (value) : NULL);
+
+  g_hash_table_unref (changeset->table);
+  changeset->table = table;
+
+  /* The index refers to the keys of the old table */
+  g_clear_pointer (&changeset->dirs, g_hash_table_unref);
+  g_clear_pointer (&changeset->serialised, g_variant_unref);
+}
+
+/* Looks up @key in a database-mode changeset (transfer none) */
+static GVariant *
+dconf_changeset_database_lookup (DConfChangeset *changeset,
+                                 const gchar    *key)
+{
+  gpointer value;
+
+  if (g_hash_table_lookup_extended (changeset->table, key, NULL, &value))
+    return value;
+
+  if (changeset->snapshot)
+    return g_hash_table_lookup (changeset->snapshot->table, key);
+
+  return NULL;
+}
+
+static void
+dconf_changeset_dir_free (gpointer data)
+{
+  DConfChangesetDir *dir = data;
+
+  if (dir->subdirs)
+    g_hash_table_unref (dir->subdirs);
+
+  if (dir->keys)
+    g_hash_table_unref (dir->keys);
+
+  g_free (dir->path);
+
+  g_slice_free (DConfChangesetDir, dir);
+}
+
+/* Returns the length of the dir containing the first @length bytes of
+ * @path (which may be a key or a dir other than "/").
+ */
+static gsize
+dconf_changeset_parent_length (const gchar *path,
+                               gsize        length)
+{
+  g_assert (length > 1);
+
+  length--;
+  while (path[length - 1] != '/')
+    length--;
+
+  return length;
+}
+
+/* Looks up the dir formed by the first @length bytes of @path */
+static DConfChangesetDir *
+dconf_changeset_lookup_dir (GHashTable  *dirs,
+                            const gchar *path,
+                            gsize        length)
+{
+  DConfChangesetDir *dir;
+  gchar buffer[256];
+  gchar *copy;
+
+  if (path[length] == '\0')
+    return g_hash_table_lookup (dirs, path);
+
+  copy = length < sizeof buffer ? buffer : g_malloc (length + 1);
+  memcpy (copy, path, length);
+  copy[length] = '\0';
+
+  dir = g_hash_table_lookup (dirs, copy);
+
+  if (copy != buffer)
+    g_free (copy);
+
+  return dir;
+}
+
+static DConfChangesetDir *
+dconf_changeset_ensure_dir (GHashTable  *dirs,
+                            const gchar *path,
+                            gsize        length)
+{
+  DConfChangesetDir *dir;
+
+  dir = dconf_changeset_lookup_dir (dirs, path, length);
+
+  if (dir == NULL)
+    {
+      dir = g_slice_new0 (DConfChangesetDir);
+      dir->path = g_strndup (path, length);
+
+      if (length > 1)
+        {
+          gsize parent_length;
+
+          parent_length = dconf_changeset_parent_length (path, length);
+          dir->parent = dconf_changeset_ensure_dir (dirs, path, parent_length);
+
+          if (dir->parent->subdirs == NULL)
+            dir->parent->subdirs = g_hash_table_new (NULL, NULL);
+
+          g_hash_table_add (dir->parent->subdirs, dir);
+        }
+
+      g_hash_table_insert (dirs, dir->path, dir);
+    }
+
+  return dir;
+}
+
+/* Removes @dir, and then any of its parents, for as long as they are
+ * empty.
+ */
+static void
+dconf_changeset_prune_dir (GHashTable        *dirs,
+                           DConfChangesetDir *dir)
+{
+  while (dir != NULL && !dir->is_reset &&
+         (dir->keys == NULL || g_hash_table_size (dir->keys) == 0) &&
+         (dir->subdirs == NULL || g_hash_table_size (dir->subdirs) == 0))
+    {
+      DConfChangesetDir *parent = dir->parent;
+
+      if (parent != NULL)
+        g_hash_table_remove (parent->subdirs, dir);
+
+      g_hash_table_remove (dirs, dir->path);
+      dir = parent;
+    }
+}
+
+/* Records @path, which must be the key of a new entry in the table
+ * that @dirs is the index of
+ */
+static void
+dconf_changeset_index_add (GHashTable  *dirs,
+                           const gchar *path)
+{
+  DConfChangesetDir *dir;
+  gsize length;
+
+  length = strlen (path);
+
+  if (path[length - 1] == '/')
+    {
+      dir = dconf_changeset_ensure_dir (dirs, path, length);
+      dir->is_reset = TRUE;
+    }
+  else
+    {
+      dir = dconf_changeset_ensure_dir (dirs, path, dconf_changeset_parent_length (path, length));
+
+      if (dir->keys == NULL)
+        dir->keys = g_hash_table_new (g_str_hash, g_str_equal);
+
+      g_hash_table_add (dir->keys, (gpointer) path);
+    }
+}
+
+static void
+dconf_changeset_index_remove (GHashTable  *dirs,
+                              const gchar *path)
+{
+  DConfChangesetDir *dir;
+  gsize length;
+
+  length = strlen (path);
+
+  if (path[length - 1] == '/')
+    {
+      dir = dconf_changeset_lookup_dir (dirs, path, length);
+      dir->is_reset = FALSE;
+    }
+  else
+    {
+      dir = dconf_changeset_lookup_dir (dirs, path, dconf_changeset_parent_length (path, length));
+      g_hash_table_remove (dir->keys, path);
+    }
+
+  dconf_changeset_prune_dir (dirs, dir);
+}
+
+static GHashTable *
+dconf_changeset_index_new (GHashTable *table)
+{
+  GHashTableIter iter;
+  GHashTable *dirs;
+  gpointer key;
+
+  dirs = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, dconf_changeset_dir_free);
+
+  g_hash_table_iter_init (&iter, table);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    dconf_changeset_index_add (dirs, key);
+
+  return dirs;
+}
+
+/* The index is only built the first time that it is needed, and kept
+ * up to date from then on.  Most changesets contain only a handful of
+ * keys and never have any prefix operations done on them.
+ *
+ * If there is a snapshot then this only indexes the differences from
+ * it.  See dconf_changeset_snapshot_get_dirs() for the rest.
+ */
+static void
+dconf_changeset_ensure_index (DConfChangeset *changeset)
+{
+  if (changeset->dirs == NULL)
+    changeset->dirs = dconf_changeset_index_new (changeset->table);
+}
+
+/* The snapshot may be in use by several changesets, so its index is
+ * built at most once and never modified afterwards.
+ */
+static GHashTable *
+dconf_changeset_snapshot_get_dirs (DConfChangesetSnapshot *snapshot)
+{
+  if (g_once_init_enter (&snapshot->dirs))
+    g_once_init_leave (&snapshot->dirs, dconf_changeset_index_new (snapshot->table));
+
+  return snapshot->dirs;
+}
+
+/* Checks if any key inside of @dir, which is from either index of the
+ * database-mode @changeset, has a value.  This stops at the first one,
+ * so without a snapshot it is O(depth).
+ */
+static gboolean
+dconf_changeset_dir_has_value (DConfChangeset    *changeset,
+                               DConfChangesetDir *dir)
+{
+  GHashTableIter iter;
+  gpointer item;
+
+  if (dir->keys)
+    {
+      g_hash_table_iter_init (&iter, dir->keys);
+      while (g_hash_table_iter_next (&iter, &item, NULL))
+        if (dconf_changeset_database_lookup (changeset, item) != NULL)
+          return TRUE;
+    }
+
+  if (dir->subdirs)
+    {
+      g_hash_table_iter_init (&iter, dir->subdirs);
+      while (g_hash_table_iter_next (&iter, &item, NULL))
+        if (dconf_changeset_dir_has_value (changeset, item))
+          return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Checks if the database-mode @changeset has any keys inside of @path */
+static gboolean
+dconf_changeset_database_has_dir (DConfChangeset *changeset,
+                                  const gchar    *path)
+{
+  DConfChangesetDir *dir;
+  gsize length;
+
+  length = strlen (path);
+
+  dconf_changeset_ensure_index (changeset);
+  dir = dconf_changeset_lookup_dir (changeset->dirs, path, length);
+  if (dir != NULL && dconf_changeset_dir_has_value (changeset, dir))
+    return TRUE;
+
+  if (changeset->snapshot == NULL)
+    return FALSE;
+
+  dir = dconf_changeset_lookup_dir (dconf_changeset_snapshot_get_dirs (changeset->snapshot), path, length);
+
+  return dir != NULL && dconf_changeset_dir_has_value (changeset, dir);
+}
+
+/* Takes ownership of @value */
+static void
+dconf_changeset_insert (DConfChangeset *changeset,
+                        const gchar    *path,
+                        GVariant       *value)
+{
+  gboolean is_new;
+  gchar *key;
+
+  is_new = !g_hash_table_contains (changeset->table, path);
+
+  key = changeset->serialised ? (gchar *) path : g_strdup (path);
+  g_hash_table_insert (changeset->table, key, value);
+
+  if (is_new)
+    {
+      if (g_str_has_suffix (key, "/"))
+        changeset->n_dir_resets++;
+
+      if (changeset->dirs)
+        dconf_changeset_index_add (changeset->dirs, key);
+    }
+}
+
+static void
+dconf_changeset_remove (DConfChangeset *changeset,
+                        const gchar    *path)
+{
+  if (!g_hash_table_contains (changeset->table, path))
+    return;
+
+  if (g_str_has_suffix (path, "/"))
+    changeset->n_dir_resets--;
+
+  if (changeset->dirs)
+    dconf_changeset_index_remove (changeset->dirs, path);
+
+  g_hash_table_remove (changeset->table, path);
+}
+
+/* Removes every path inside of @dir (including @dir itself) from the
+ * table, and frees all of the dirs below @dir.  @dir itself is left for
+ * the caller to free.
+ */
+static void
+dconf_changeset_remove_dir_contents (DConfChangeset    *changeset,
+                                     DConfChangesetDir *dir)
+{
+  if (dir->subdirs)
+    {
+      GHashTableIter iter;
+      gpointer subdir;
+
+      g_hash_table_iter_init (&iter, dir->subdirs);
+      while (g_hash_table_iter_next (&iter, &subdir, NULL))
+        {
+          dconf_changeset_remove_dir_contents (changeset, subdir);
+          g_hash_table_remove (changeset->dirs, ((DConfChangesetDir *) subdir)->path);
+        }
+
+      g_hash_table_remove_all (dir->subdirs);
+    }
+
+  if (dir->keys)
+    {
+      GHashTableIter iter;
+      gpointer key;
+
+      g_hash_table_iter_init (&iter, dir->keys);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        g_hash_table_remove (changeset->table, key);
+
+      g_hash_table_remove_all (dir->keys);
+    }
+
+  if (dir->is_reset)
+    {
+      g_hash_table_remove (changeset->table, dir->path);
+      changeset->n_dir_resets--;
+      dir->is_reset = FALSE;
+    }
+}
+
+/* Hides every key inside of @dir, which is from the index of the
+ * snapshot of @changeset, by recording that it has been removed.
+ */
+static void
+dconf_changeset_hide_dir_contents (DConfChangeset    *changeset,
+                                   DConfChangesetDir *dir)
+{
+  GHashTableIter iter;
+  gpointer item;
+
+  if (dir->subdirs)
+    {
+      g_hash_table_iter_init (&iter, dir->subdirs);
+      while (g_hash_table_iter_next (&iter, &item, NULL))
+        dconf_changeset_hide_dir_contents (changeset, item);
+    }
+
+  if (dir->keys)
+    {
+      g_hash_table_iter_init (&iter, dir->keys);
+      while (g_hash_table_iter_next (&iter, &item, NULL))
+        dconf_changeset_insert (changeset, item, NULL);
+    }
+}
+
+/* Checks if @key is inside of a dir that is reset by @changeset */
+static gboolean
+dconf_changeset_has_dir_reset_for (DConfChangeset *changeset,
+                                   const gchar    *key)
+{
+  gboolean result = FALSE;
+  gchar buffer[256];
+  gsize length;
+  gchar *copy;
+  gsize i;
+
+  length = strlen (key);
+  copy = length < sizeof buffer ? buffer : g_malloc (length + 1);
+  memcpy (copy, key, length + 1);
+
+  /* Visit each of the parent dirs of @key, starting at the root.  Since
+   * dirs are only in the index if they have contents, we can stop as
+   * soon as we find one that is missing.
+   */
+  for (i = 0; i < length; i++)
+    if (copy[i] == '/')
+      {
+        DConfChangesetDir *dir;
+        gchar saved;
+
+        saved = copy[i + 1];
+        copy[i + 1] = '\0';
+        dir = g_hash_table_lookup (changeset->dirs, copy);
+        copy[i + 1] = saved;
+
+        if (dir == NULL)
+          break;
+
+        if (dir->is_reset)
+          {
+            result = TRUE;
+            break;
+          }
+      }
+
+  if (copy != buffer)
+    g_free (copy);
+
+  return result;
+}
+
 /**
  * dconf_changeset_new:
  *
@@ -84,7 +698,7 @@ dconf_changeset_new (void)
   DConfChangeset *changeset;
 
   changeset = g_slice_new0 (DConfChangeset);
-  changeset->table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, unref_gvariant0);
+  changeset->table = dconf_changeset_table_new ();
   changeset->ref_count = 1;
 
   return changeset;
@@ -114,6 +728,11 @@ dconf_changeset_new (void)
  * If @copy_of is non-%NULL then its contents will be copied into the
  * created changeset.  @copy_of must be a database-mode changeset.
  *
+ * Unless @copy_of is sealed, the copy shares its contents with @copy_of
+ * until either of them is modified, and then only the modified keys
+ * are stored separately.  Copying a large database in order to make a
+ * few changes to it is therefore cheap.
+ *
  * Returns: (transfer full): a new #DConfChangeset in "database" mode
  *
  * Since: 0.16
@@ -128,14 +747,30 @@ dconf_changeset_new_database (DConfChangeset *copy_of)
   changeset = dconf_changeset_new ();
   changeset->is_database = TRUE;
 
-  if (copy_of)
+  if (copy_of && !copy_of->is_sealed)
     {
       GHashTableIter iter;
       gpointer key, value;
 
+      changeset->snapshot = dconf_changeset_share (copy_of);
+
+      /* Take a copy of the differences, if there are any */
       g_hash_table_iter_init (&iter, copy_of->table);
       while (g_hash_table_iter_next (&iter, &key, &value))
-        g_hash_table_insert (changeset->table, g_strdup (key), g_variant_ref (value));
+        g_hash_table_insert (changeset->table, g_strdup (key), value ? g_variant_ref (value) : NULL);
+    }
+  else if (copy_of)
+    {
+      GHashTableIter iter;
+      gpointer key, value;
+
+      /* Sealed changesets may be in use from other threads, so we can't
+       * move their contents into a snapshot.  They are never layered on
+       * top of one, though, so this is a plain copy.
+       */
+      g_hash_table_iter_init (&iter, copy_of->table);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        dconf_changeset_insert (changeset, key, g_variant_ref (value));
     }
 
   return changeset;
@@ -156,10 +791,16 @@ dconf_changeset_unref (DConfChangeset *changeset)
       g_free (changeset->paths);
       g_free (changeset->values);
 
+      if (changeset->dirs)
+        g_hash_table_unref (changeset->dirs);
+
+      if (changeset->snapshot)
+        dconf_changeset_snapshot_unref (changeset->snapshot);
+
       g_hash_table_unref (changeset->table);
 
-      if (changeset->dir_resets)
-        g_hash_table_unref (changeset->dir_resets);
+      if (changeset->serialised)
+        g_variant_unref (changeset->serialised);
 
       g_slice_free (DConfChangeset, changeset);
     }
@@ -189,11 +830,7 @@ dconf_changeset_record_dir_reset (DConfChangeset *changeset,
   g_return_if_fail (!changeset->is_database);
   g_return_if_fail (!changeset->is_sealed);
 
-  if (!changeset->dir_resets)
-    changeset->dir_resets = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-
-  g_hash_table_insert (changeset->table, g_strdup (dir), NULL);
-  g_hash_table_add (changeset->dir_resets, g_strdup (dir));
+  dconf_changeset_insert (changeset, dir, NULL);
 }
 
 /**
@@ -219,21 +856,38 @@ dconf_changeset_set (DConfChangeset *changeset,
   g_return_if_fail (!changeset->is_sealed);
   g_return_if_fail (dconf_is_path (path, NULL));
 
+  dconf_changeset_own_keys (changeset);
+
   /* Check if we are performing a path reset */
   if (g_str_has_suffix (path, "/"))
     {
-      GHashTableIter iter;
-      gpointer key;
+      DConfChangesetDir *dir;
 
       g_return_if_fail (value == NULL);
 
       /* When we reset a path we must also reset all keys within that
        * path.
        */
-      g_hash_table_iter_init (&iter, changeset->table);
-      while (g_hash_table_iter_next (&iter, &key, NULL))
-        if (g_str_has_prefix (key, path))
-          g_hash_table_iter_remove (&iter);
+      dconf_changeset_ensure_index (changeset);
+      dir = dconf_changeset_lookup_dir (changeset->dirs, path, strlen (path));
+
+      if (dir != NULL)
+        {
+          dconf_changeset_remove_dir_contents (changeset, dir);
+          dconf_changeset_prune_dir (changeset->dirs, dir);
+        }
+
+      /* Keys in the snapshot can't be removed from it, so they are
+       * hidden instead.  This is O(keys in the dir), not O(database).
+       */
+      if (changeset->snapshot)
+        {
+          dir = dconf_changeset_lookup_dir (dconf_changeset_snapshot_get_dirs (changeset->snapshot),
+                                            path, strlen (path));
+
+          if (dir != NULL)
+            dconf_changeset_hide_dir_contents (changeset, dir);
+        }
 
       /* If this is a non-database then record the reset itself. */
       if (!changeset->is_database)
@@ -247,14 +901,16 @@ dconf_changeset_set (DConfChangeset *changeset,
        * Otherwise, just reset whatever may be there already.
        */
       if (!changeset->is_database)
-        g_hash_table_insert (changeset->table, g_strdup (path), NULL);
+        dconf_changeset_insert (changeset, path, NULL);
+      else if (changeset->snapshot && g_hash_table_contains (changeset->snapshot->table, path))
+        dconf_changeset_insert (changeset, path, NULL);
       else
-        g_hash_table_remove (changeset->table, path);
+        dconf_changeset_remove (changeset, path);
     }
 
   /* ...or a normal write. */
   else
-    g_hash_table_insert (changeset->table, g_strdup (path), g_variant_ref_sink (value));
+    dconf_changeset_insert (changeset, path, g_variant_ref_sink (value));
 }
 
 /**
@@ -282,23 +938,38 @@ dconf_changeset_get (DConfChangeset  *changeset,
 {
   gpointer tmp;
 
+  if (changeset->is_database)
+    {
+      tmp = dconf_changeset_database_lookup (changeset, key);
+
+      if (tmp == NULL)
+        return FALSE;
+
+      if (value)
+        *value = g_variant_ref (tmp);
+
+      return TRUE;
+    }
+
   if (!g_hash_table_lookup_extended (changeset->table, key, NULL, &tmp))
     {
-      /* Did not find an exact match, so check for dir resets */
-      if (changeset->dir_resets)
+      /* Did not find an exact match, so check for dir resets.
+       *
+       * Sealed changesets with dir resets always have an index (see
+       * dconf_changeset_seal()) so we never modify a shared changeset
+       * here.
+       */
+      if (changeset->n_dir_resets > 0)
         {
-          GHashTableIter iter;
-          gpointer dir;
-
-          g_hash_table_iter_init (&iter, changeset->dir_resets);
-          while (g_hash_table_iter_next (&iter, &dir, NULL))
-            if (g_str_has_prefix (key, dir))
-              {
-                if (value)
-                  *value = NULL;
-
-                return TRUE;
-              }
+          dconf_changeset_ensure_index (changeset);
+
+          if (dconf_changeset_has_dir_reset_for (changeset, key))
+            {
+              if (value)
+                *value = NULL;
+
+              return TRUE;
+            }
         }
 
       return FALSE;
@@ -338,6 +1009,9 @@ dconf_changeset_is_similar_to (DConfChangeset *changeset,
   GHashTableIter iter;
   gpointer key;
 
+  dconf_changeset_flatten (changeset);
+  dconf_changeset_flatten (other);
+
   if (g_hash_table_size (changeset->table) != g_hash_table_size (other->table))
     return FALSE;
 
@@ -388,6 +1062,8 @@ dconf_changeset_all (DConfChangeset          *changeset,
   GHashTableIter iter;
   gpointer key, value;
 
+  dconf_changeset_flatten (changeset);
+
   g_hash_table_iter_init (&iter, changeset->table);
   while (g_hash_table_iter_next (&iter, &key, &value))
     if (!(* predicate) (key, value, user_data))
@@ -438,8 +1114,16 @@ dconf_changeset_seal (DConfChangeset *changeset)
   if (changeset->is_sealed)
     return;
 
+  dconf_changeset_flatten (changeset);
+
   changeset->is_sealed = TRUE;
 
+  /* Sealed changesets may be shared between threads, so build the index
+   * now if we could need it later.
+   */
+  if (changeset->is_database || changeset->n_dir_resets > 0)
+    dconf_changeset_ensure_index (changeset);
+
   /* This function used to be called dconf_changeset_build_description()
    * because that's basically what sealing is...
    */
@@ -586,10 +1270,10 @@ dconf_changeset_describe (DConfChangeset       *changeset,
 {
   gint n_items;
 
-  n_items = g_hash_table_size (changeset->table);
-
   dconf_changeset_seal (changeset);
 
+  n_items = g_hash_table_size (changeset->table);
+
   if (prefix)
     *prefix = changeset->prefix;
 
@@ -622,6 +1306,8 @@ dconf_changeset_serialise (DConfChangeset *changeset)
 
   g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{smv}"));
 
+  dconf_changeset_flatten (changeset);
+
   g_hash_table_iter_init (&iter, changeset->table);
   while (g_hash_table_iter_next (&iter, &key, &value))
     g_variant_builder_add (&builder, "{smv}", key, value);
@@ -642,6 +1328,16 @@ dconf_changeset_serialise (DConfChangeset *changeset)
  * This call never fails, even if @serialised is not in the correct
  * format.  Improperly-formatted parts are simply ignored.
  *
+ * If @serialised is serialised data in normal form then no copy is
+ * made of the keys and values in it: the changeset holds a reference
+ * on @serialised instead, until the changeset is first modified.
+ *
+ * This means that the whole of @serialised stays in memory for as long
+ * as the changeset is alive, even if only a few of its keys are still
+ * of interest.  The values are views into @serialised as well, so it
+ * is also kept alive by any value taken from the changeset.  Copy what
+ * you need and release the changeset if that is a concern.
+ *
  * Returns: (transfer full): a new #DConfChangeset
  **/
 DConfChangeset *
@@ -653,6 +1349,25 @@ dconf_changeset_deserialise (GVariant *serialised)
   GVariant *value;
 
   changeset = dconf_changeset_new ();
+
+  /* Borrow the keys, if we can.  The values are already views into
+   * @serialised.
+   *
+   * Strings are only guaranteed to point into @serialised if it is
+   * serialised and in normal form.  A tree-form variant (such as the
+   * result of dconf_changeset_serialise()) frees its children as soon
+   * as anyone serialises it, so do that first.  Otherwise invalid parts
+   * may be replaced with default values that only live as long as the
+   * iteration.
+   */
+  if (g_variant_get_data (serialised) != NULL &&
+      g_variant_is_normal_form (serialised))
+    {
+      g_hash_table_unref (changeset->table);
+      changeset->table = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, unref_gvariant0);
+      changeset->serialised = g_variant_ref (serialised);
+    }
+
   g_variant_iter_init (&iter, serialised);
   while (g_variant_iter_loop (&iter, "{&smv}", &key, &value))
     {
@@ -664,7 +1379,7 @@ dconf_changeset_deserialise (GVariant *serialised)
        * If we get an invalid case, just fall through and ignore it.
        */
       if (dconf_is_key (key, NULL))
-        g_hash_table_insert (changeset->table, g_strdup (key), value ? g_variant_ref (value) : NULL);
+        dconf_changeset_insert (changeset, key, value ? g_variant_ref (value) : NULL);
 
       else if (dconf_is_dir (key, NULL) && value == NULL)
         dconf_changeset_record_dir_reset (changeset, key);
@@ -708,6 +1423,25 @@ dconf_changeset_new_write (const gchar *path,
 gboolean
 dconf_changeset_is_empty (DConfChangeset *changeset)
 {
+  if (changeset->snapshot)
+    {
+      GHashTableIter iter;
+      gpointer value;
+      guint removed = 0;
+
+      /* Only keys in the snapshot are ever marked as removed */
+      g_hash_table_iter_init (&iter, changeset->table);
+      while (g_hash_table_iter_next (&iter, NULL, &value))
+        {
+          if (value != NULL)
+            return FALSE;
+
+          removed++;
+        }
+
+      return removed == g_hash_table_size (changeset->snapshot->table);
+    }
+
   return !g_hash_table_size (changeset->table);
 }
 
@@ -798,6 +1532,8 @@ dconf_changeset_filter_changes (DConfChangeset *base,
 
   g_return_val_if_fail (base->is_database, NULL);
 
+  dconf_changeset_flatten (changes);
+
   /* We create the list of changes by iterating the 'changes' changeset
    * and noting any keys that are not in the 'base' changeset or do not
    * have the same value in the 'base' changeset
@@ -808,25 +1544,18 @@ dconf_changeset_filter_changes (DConfChangeset *base,
   g_hash_table_iter_init (&iter_changes, changes->table);
   while (g_hash_table_iter_next (&iter_changes, &key, &val))
     {
-      GVariant *base_val = g_hash_table_lookup (base->table, key);
+      GVariant *base_val = dconf_changeset_database_lookup (base, key);
 
       if (g_str_has_suffix (key, "/"))
         {
           // Path reset
-          gboolean reset_is_effective = FALSE;
-          GHashTableIter iter_base;
-          gpointer base_key = NULL;
+          gboolean reset_is_effective;
 
           g_return_val_if_fail (val == NULL, NULL);
 
-          // First we check whether there are any keys in base that would be reset
-          g_hash_table_iter_init (&iter_base, base->table);
-          while (g_hash_table_iter_next (&iter_base, &base_key, NULL))
-            if (g_str_has_prefix (base_key, key) && !g_str_equal (base_key, key))
-              {
-                reset_is_effective = TRUE;
-                break;
-              }
+          // First we check whether there are any keys in base that would be reset.
+          // This uses the indexes of base and its snapshot, so it never flattens.
+          reset_is_effective = dconf_changeset_database_has_dir (base, key);
 
           if (reset_is_effective)
             {
@@ -901,6 +1630,9 @@ dconf_changeset_diff (DConfChangeset *from,
 
   changeset = dconf_changeset_filter_changes (from, to);
 
+  dconf_changeset_flatten (from);
+  dconf_changeset_flatten (to);
+
   g_hash_table_iter_init (&iter, from->table);
   while (g_hash_table_iter_next (&iter, &key, &val))
     if (!g_hash_table_lookup (to->table, key))
@@ -31,35 +31,44 @@
 #include <glib/gstdio.h>
 #include <string.h>
 
-DConfChangeset *
-dconf_gvdb_utils_changeset_from_table (GvdbTable *table)
+typedef struct
+{
+  GvdbTable      *table;
+  DConfChangeset *database;
+} ChangesetFromTable;
+
+static void
+dconf_gvdb_utils_add_name (const gchar *name,
+                           gsize        length,
+                           gpointer     user_data)
 {
-  DConfChangeset *database = dconf_changeset_new_database (NULL);
-  gchar **names;
-  gsize n_names;
-  gsize i;
+  ChangesetFromTable *data = user_data;
 
-  names = gvdb_table_get_names (table, &n_names);
-  for (i = 0; i < n_names; i++)
+  if (dconf_is_key (name, NULL))
     {
-      if (dconf_is_key (names[i], NULL))
-        {
-          GVariant *value;
+      GVariant *value;
 
-          value = gvdb_table_get_value (table, names[i]);
+      value = gvdb_table_get_value (data->table, name);
 
-          if (value != NULL)
-            {
-              dconf_changeset_set (database, names[i], value);
-              g_variant_unref (value);
-            }
+      if (value != NULL)
+        {
+          dconf_changeset_set (data->database, name, value);
+          g_variant_unref (value);
         }
-
-      g_free (names[i]);
     }
+}
 
-  g_free (names);
-  return database;
+DConfChangeset *
+dconf_gvdb_utils_changeset_from_table (GvdbTable *table)
+{
+  ChangesetFromTable data;
+
+  data.table = table;
+  data.database = dconf_changeset_new_database (NULL);
+
+  gvdb_table_foreach_name (table, dconf_gvdb_utils_add_name, &data);
+
+  return data.database;
 }
 
 DConfChangeset *
@@ -203,6 +212,59 @@ dconf_gvdb_utils_table_from_changeset (DConfChangeset *database)
   return table;
 }
 
+static void
+dconf_gvdb_utils_apply_change (GHashTable  *gvdb,
+                               const gchar *path,
+                               GVariant    *value)
+{
+  if (dconf_is_dir (path, NULL))
+    {
+      /* Only a reset is possible on a directory.  The dir item lists
+       * everything below it, so this costs only the size of the subtree.
+       */
+      g_assert (value == NULL);
+
+      gvdb_hash_table_remove_tree (gvdb, path);
+    }
+  else if (value == NULL)
+    gvdb_hash_table_remove (gvdb, path);
+  else
+    {
+      GvdbItem *item;
+
+      item = g_hash_table_lookup (gvdb, path);
+
+      if (item == NULL)
+        {
+          item = gvdb_hash_table_insert (gvdb, path);
+          gvdb_item_set_parent (item, dconf_gvdb_utils_get_parent (gvdb, path));
+        }
+
+      gvdb_item_set_value (item, value);
+    }
+}
+
+void
+dconf_gvdb_utils_table_apply_changeset (GHashTable     *table,
+                                        DConfChangeset *changes)
+{
+  const gchar * const *paths;
+  const gchar *prefix;
+  GVariant * const *values;
+  gsize prefix_len;
+  guint n, i;
+
+  /* As in dconf_changeset_change(), visit the paths in sorted order so
+   * that a directory reset is processed before any writes below it.
+   */
+  n = dconf_changeset_describe (changes, &prefix, &paths, &values);
+  prefix_len = strlen (prefix);
+
+  for (i = 0; i < n; i++)
+    /* paths[] point into the full keys, just past the prefix */
+    dconf_gvdb_utils_apply_change (table, paths[i] - prefix_len, values[i]);
+}
+
 gboolean
 dconf_gvdb_utils_write_file (const gchar     *filename,
                              DConfChangeset  *database,
@@ -212,6 +274,19 @@ dconf_gvdb_utils_write_file (const gchar     *filename,
   gboolean success;
 
   gvdb = dconf_gvdb_utils_table_from_changeset (database);
+  success = dconf_gvdb_utils_write_table (filename, gvdb, error);
+  g_hash_table_unref (gvdb);
+
+  return success;
+}
+
+gboolean
+dconf_gvdb_utils_write_table (const gchar  *filename,
+                              GHashTable   *gvdb,
+                              GError      **error)
+{
+  gboolean success;
+
   success = gvdb_table_write_contents (gvdb, filename, FALSE, error);
 
   if (!success)
@@ -229,7 +304,5 @@ dconf_gvdb_utils_write_file (const gchar     *filename,
       success = gvdb_table_write_contents (gvdb, filename, FALSE, error);
     }
 
-  g_hash_table_unref (gvdb);
-
   return success;
 }
@@ -29,8 +29,13 @@ DConfChangeset *                dconf_gvdb_utils_read_and_back_up_file  (const g
                                                                          gboolean        *file_missing,
                                                                          GError         **error);
 GHashTable *                    dconf_gvdb_utils_table_from_changeset   (DConfChangeset  *database);
+void                            dconf_gvdb_utils_table_apply_changeset  (GHashTable      *table,
+                                                                         DConfChangeset  *changes);
 gboolean                        dconf_gvdb_utils_write_file             (const gchar     *filename,
                                                                          DConfChangeset  *database,
                                                                          GError         **error);
+gboolean                        dconf_gvdb_utils_write_table            (const gchar     *filename,
+                                                                         GHashTable      *gvdb,
+                                                                         GError         **error);
 
 #endif /* __dconf_gvdb_utils_h__ */
@@ -40,6 +40,12 @@ dconf_engine_source_free (DConfEngineSource *source)
   g_free (source);
 }
 
+gboolean
+dconf_engine_source_needs_reopen (DConfEngineSource *source)
+{
+  return source->vtable->needs_reopen (source);
+}
+
 gboolean
 dconf_engine_source_refresh (DConfEngineSource *source)
 {
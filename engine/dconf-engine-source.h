@@ -54,6 +54,9 @@ struct _DConfEngineSource
 G_GNUC_INTERNAL
 void                    dconf_engine_source_free                        (DConfEngineSource  *source);
 
+G_GNUC_INTERNAL
+gboolean                dconf_engine_source_needs_reopen                (DConfEngineSource  *source);
+
 G_GNUC_INTERNAL
 gboolean                dconf_engine_source_refresh                     (DConfEngineSource  *source);
 
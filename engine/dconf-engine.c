@@ -24,7 +24,6 @@
 
 #include "../common/dconf-enums.h"
 #include "../common/dconf-paths.h"
-#include "../common/dconf-gvdb-utils.h"
 #include "../gvdb/gvdb-reader.h"
 #include <string.h>
 #include <stdlib.h>
@@ -81,12 +80,18 @@
  * (needlessly) busy rewriting the database over and over again after a
  * sequence of fast changes on the client side.
  *
- * To avoid the issue we limit the number of in-flight requests to one.
- * If a request is already in flight, subsequent changes are merged into
- * a single aggregated pending change to be submitted as the next write
- * after the in-flight request completes.
+ * To avoid the issue we limit the number of in-flight requests.  The
+ * limit is one unless DCONF_FAST_WRITE_DEPTH is set.  That variable is
+ * read whenever an engine is created, so it applies to the whole
+ * process rather than to a particular writer: it is a tuning and
+ * debugging knob, not an API.  Once the limit is reached, subsequent
+ * changes are merged into a single aggregated pending change to be
+ * submitted as the next write after the oldest in-flight request
+ * completes.
  *
- * NB: I tell a lie.  Async is not supported yet.
+ * Asynchronous changes do not go through that queue: each one is sent
+ * immediately as its own request, so any number of them may be
+ * outstanding at once.
  *
  * Notes about threading:
  *
@@ -113,20 +118,30 @@
  * The first lock (sources_lock) protects the sources.  Although the
  * sources are only ever read from, it is necessary to lock them because
  * it is not safe to read during a refresh (when the source is being
- * closed and reopened).  Accordingly, sources_lock need only be
- * acquired when accessing the parts of the sources that are subject to
- * change as a result of refreshes; the static parts (like bus type,
- * object path, etc) can be accessed without holding the lock.  The
- * 'sources' array itself (and 'n_sources') are set at construction and
- * never change after that.
+ * closed and reopened).  This is a reader/writer lock: any number of
+ * threads can hold it for reading at the same time, and the writer lock
+ * is only taken in order to refresh sources that need reopening.
+ * Accordingly, sources_lock need only be acquired when accessing the
+ * parts of the sources that are subject to change as a result of
+ * refreshes; the static parts (like bus type, object path, etc) can be
+ * accessed without holding the lock.  The 'sources' array itself (and
+ * 'n_sources') are set at construction and never change after that.
  *
  * The second lock (queue_lock) protects the queue (represented with two
  * fields pending and in_flight) used to implement the "fast" writes
- * described above.
+ * described above.  The number of changesets in the queue is mirrored
+ * in queue_length, which is only modified with the lock held
+ * but may be read atomically without it.  This lets reads skip the
+ * lock in the (very common) case that nothing is queued.
  *
- * The third lock (subscription_count_lock) protects the two hash tables
- * that are used to keep track of the number of subscriptions held by
- * the client library to each path.
+ * The third lock (subscription_count_lock) protects the watch registry:
+ * the trie that is used to keep track of the number of subscriptions
+ * held by the client library to each path, and of which paths have a
+ * D-Bus match rule.
+ *
+ * There is also a small lock (cache_lock) for the optional read cache.
+ * It is only ever taken while holding sources_lock (for reading) and
+ * nothing else is acquired while it is held.
  *
  * If sources_lock and queue_lock are held at the same time then then
  * sources_lock must have been acquired first.
@@ -135,8 +150,19 @@
  * sources_lock or queue_lock
  */
 
-static GSList *dconf_engine_global_list;
-static GMutex  dconf_engine_global_lock;
+typedef struct _DConfEngineWatchNode DConfEngineWatchNode;
+
+/* Index of the engines that are interested in the signals of each
+ * (bus type, object path) pair, so that incoming signals can be
+ * dispatched without visiting every engine.  Only sources with a bus
+ * type are included.
+ *
+ * The table only changes when an engine is constructed or destroyed.
+ * Signal dispatch only takes the reader side of the lock, so it never
+ * waits for other signals that are being dispatched in parallel.
+ */
+static GHashTable *dconf_engine_signal_index;  /* DConfEngineSignalKey -> GPtrArray of DConfEngine */
+static GRWLock     dconf_engine_signal_index_lock;
 
 struct _DConfEngine
 {
@@ -144,7 +170,7 @@ struct _DConfEngine
   GDestroyNotify      free_func;
   gint                ref_count;
 
-  GMutex              sources_lock;  /* This lock is for the sources (ie: refreshing) and state. */
+  GRWLock             sources_lock;  /* This lock is for the sources (ie: refreshing) and state. */
   guint64             state;         /* Counter that changes every time a source is refreshed. */
   DConfEngineSource **sources;       /* Array never changes, but each source changes internally. */
   gint                n_sources;
@@ -152,20 +178,28 @@ struct _DConfEngine
   GMutex              queue_lock;    /* This lock is for pending, in_flight, queue_cond */
   GCond               queue_cond;    /* Signalled when there are neither in-flight nor pending changes. */
   DConfChangeset     *pending;       /* Yet to be sent on the wire. */
-  DConfChangeset     *in_flight;     /* Already sent but awaiting response. */
+  GQueue              in_flight;     /* Already sent but awaiting response, oldest first. */
+  guint               max_in_flight; /* Never changes after construction. */
+  gint                queue_length;  /* Count of all of the above.  Atomic. */
 
-  gchar              *last_handled;  /* reply tag from last item in in_flight */
+  GQueue              last_handled;  /* reply tags from the most recently completed
+                                      * items in in_flight, up to max_in_flight */
 
-  /**
-   * establishing and active, are hash tables storing the number
-   * of subscriptions to each path in the two possible states
+  /* Optional cache of values returned by plain reads, enabled by
+   * setting DCONF_READ_CACHE_SIZE.  Entries are only valid for the
+   * state recorded in cache_state; any refresh clears the cache.
    */
+  GMutex              cache_lock;
+  GHashTable         *cache;         /* key -> GVariant (or NULL) */
+  guint               cache_size;    /* Maximum number of entries. 0 if disabled. */
+  guint64             cache_state;
+  guint64             cache_hits;
+  guint64             cache_misses;
+
   /* This lock ensures that transactions involving subscription counts are atomic */
   GMutex              subscription_count_lock;
-  /* active on the client side, but awaiting confirmation from the writer */
-  GHashTable         *establishing;
-  /* active on the client side, and with a D-Bus match rule established */
-  GHashTable         *active;
+  /* Subscription counts and match rules, by path.  See below. */
+  DConfEngineWatchNode *watches;
 };
 
 /* When taking the sources lock we check if any of the databases have
@@ -180,31 +214,54 @@ struct _DConfEngine
  * we are only interested in checking writability) but this works well
  * enough for now and is less prone to errors.
  *
- * We could probably change to a reader/writer situation that is only
- * holding the write lock when actually making changes during a refresh
- * but the engine is probably only ever really in use by two threads at
- * a given time (main thread doing reads, DBus worker thread clearing
- * the queue) so it seems unlikely that lock contention will become an
- * issue.
+ * Checking if a source needs to be reopened only involves looking at
+ * the shm flag or the gvdb header, so we do that with the reader lock
+ * held.  Only if a source actually needs reopening do we drop it and
+ * take the writer lock to do the refresh.  In the common case, readers
+ * in different threads therefore never block each other.
  *
- * If it does, we can revisit this...
+ * We don't loop after the refresh: if a source is still in need of
+ * reopening (because a system database is missing, for example) then
+ * we would otherwise never make progress.  The next acquire will try
+ * again, as before.
  */
+static gboolean
+dconf_engine_sources_need_refresh (DConfEngine *engine)
+{
+  gint i;
+
+  for (i = 0; i < engine->n_sources; i++)
+    if (dconf_engine_source_needs_reopen (engine->sources[i]))
+      return TRUE;
+
+  return FALSE;
+}
+
 static void
 dconf_engine_acquire_sources (DConfEngine *engine)
 {
   gint i;
 
-  g_mutex_lock (&engine->sources_lock);
+  g_rw_lock_reader_lock (&engine->sources_lock);
+
+  if (!dconf_engine_sources_need_refresh (engine))
+    return;
+
+  g_rw_lock_reader_unlock (&engine->sources_lock);
+  g_rw_lock_writer_lock (&engine->sources_lock);
 
   for (i = 0; i < engine->n_sources; i++)
     if (dconf_engine_source_refresh (engine->sources[i]))
       engine->state++;
+
+  g_rw_lock_writer_unlock (&engine->sources_lock);
+  g_rw_lock_reader_lock (&engine->sources_lock);
 }
 
 static void
 dconf_engine_release_sources (DConfEngine *engine)
 {
-  g_mutex_unlock (&engine->sources_lock);
+  g_rw_lock_reader_unlock (&engine->sources_lock);
 }
 
 static void
@@ -219,76 +276,268 @@ dconf_engine_unlock_queue (DConfEngine *engine)
   g_mutex_unlock (&engine->queue_lock);
 }
 
+/* The watch registry.
+ *
+ * A match rule with arg0path='/a/' delivers the signals for every path
+ * below /a/, so once a dir is watched there is no need for separate
+ * match rules for the paths inside of it.  Subscriptions are kept in a
+ * trie with one node per path component ("a/", "b/", "c") so that such
+ * relationships are cheap to find.
+ *
+ * Each node counts the subscriptions to its exact path.  A node has a
+ * match rule if and only if it is watched and none of its parents are:
+ *
+ *  - watching a path that is below a watched dir is free
+ *
+ *  - watching a dir takes over the rules of any paths below it
+ *
+ *  - unwatching a dir hands its rule back to the topmost watched paths
+ *    below it
+ *
+ * When rules change hands, the new rules are always sent before the old
+ * ones are removed so that the bus daemon (which handles the requests
+ * of a connection in order) never drops a signal in between.
+ */
+struct _DConfEngineWatchNode
+{
+  DConfEngineWatchNode *parent;
+  GHashTable           *children;  /* component -> DConfEngineWatchNode, or NULL */
+  gchar                *path;
+  guint                 count;     /* subscriptions to exactly this path */
+  gboolean              has_rule;
+};
+
+static DConfEngineWatchNode *
+dconf_engine_watch_node_new (DConfEngineWatchNode *parent,
+                             gchar                *path)
+{
+  DConfEngineWatchNode *node;
+
+  node = g_slice_new0 (DConfEngineWatchNode);
+  node->parent = parent;
+  node->path = path;
+
+  return node;
+}
+
+static void
+dconf_engine_watch_node_free (gpointer data)
+{
+  DConfEngineWatchNode *node = data;
+
+  g_clear_pointer (&node->children, g_hash_table_unref);
+  g_free (node->path);
+
+  g_slice_free (DConfEngineWatchNode, node);
+}
+
+/**
+ * Finds the node for @path, optionally creating it (and its parents).
+ */
+static DConfEngineWatchNode *
+dconf_engine_watch_node_lookup (DConfEngineWatchNode *root,
+                                const gchar          *path,
+                                gboolean              create)
+{
+  DConfEngineWatchNode *node = root;
+  const gchar *component;
+
+  g_assert (path[0] == '/');
+
+  for (component = path + 1; *component; )
+    {
+      DConfEngineWatchNode *child = NULL;
+      const gchar *end;
+      gchar *name;
+
+      end = strchr (component, '/');
+      end = end ? end + 1 : component + strlen (component);
+      name = g_strndup (component, end - component);
+
+      if (node->children)
+        child = g_hash_table_lookup (node->children, name);
+
+      if (child == NULL)
+        {
+          if (!create)
+            {
+              g_free (name);
+              return NULL;
+            }
+
+          if (node->children == NULL)
+            node->children = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                    g_free, dconf_engine_watch_node_free);
+
+          child = dconf_engine_watch_node_new (node, g_strndup (path, end - path));
+          g_hash_table_insert (node->children, name, child);
+        }
+      else
+        g_free (name);
+
+      node = child;
+      component = end;
+    }
+
+  return node;
+}
+
 /**
- * Adds the count of subscriptions to @path in @from_table to the
- * corresponding count in @to_table, creating it if it did not exist.
- * Removes the count from @from_table.
+ * Removes @node, and then any of its parents, for as long as they are
+ * no longer needed.  The root is always kept.
  */
 static void
-dconf_engine_move_subscriptions (GHashTable  *from_counts,
-                                 GHashTable  *to_counts,
-                                 const gchar *path)
+dconf_engine_watch_node_prune (DConfEngineWatchNode *node)
 {
-  guint from_count = GPOINTER_TO_UINT (g_hash_table_lookup (from_counts, path));
-  guint old_to_count = GPOINTER_TO_UINT (g_hash_table_lookup (to_counts, path));
-  // Detect overflows
-  g_assert (old_to_count <= G_MAXUINT - from_count);
-  guint new_to_count = old_to_count + from_count;
-  if (from_count != 0)
+  while (node->parent && node->count == 0 && node->children == NULL)
     {
-      g_hash_table_remove (from_counts, path);
-      g_hash_table_replace (to_counts,
-                            g_strdup (path),
-                            GUINT_TO_POINTER (new_to_count));
+      DConfEngineWatchNode *parent = node->parent;
+      const gchar *name;
+
+      g_assert (!node->has_rule);
+
+      /* The component is the tail of the path */
+      name = node->path + strlen (parent->path);
+      g_hash_table_remove (parent->children, name);
+
+      if (g_hash_table_size (parent->children) == 0)
+        g_clear_pointer (&parent->children, g_hash_table_unref);
+
+      node = parent;
     }
 }
 
+static gboolean
+dconf_engine_watch_node_is_covered (DConfEngineWatchNode *node)
+{
+  while ((node = node->parent))
+    if (node->count > 0)
+      return TRUE;
+
+  return FALSE;
+}
+
 /**
- * Increments the reference count for the subscription to @path, or sets
- * it to 1 if it didn’t previously exist.
- * Returns the new reference count.
+ * Takes away the match rules of all paths below @node, adding their
+ * paths to @rules.
  */
-static guint
-dconf_engine_inc_subscriptions (GHashTable  *counts,
-                                const gchar *path)
+static void
+dconf_engine_watch_node_take_rules (DConfEngineWatchNode *node,
+                                    GPtrArray            *rules)
 {
-  guint old_count = GPOINTER_TO_UINT (g_hash_table_lookup (counts, path));
-  // Detect overflows
-  g_assert (old_count < G_MAXUINT);
-  guint new_count = old_count + 1;
-  g_hash_table_replace (counts, g_strdup (path), GUINT_TO_POINTER (new_count));
-  return new_count;
+  GHashTableIter iter;
+  gpointer child_p;
+
+  if (node->children == NULL)
+    return;
+
+  g_hash_table_iter_init (&iter, node->children);
+  while (g_hash_table_iter_next (&iter, NULL, &child_p))
+    {
+      DConfEngineWatchNode *child = child_p;
+
+      if (child->has_rule)
+        {
+          child->has_rule = FALSE;
+          g_ptr_array_add (rules, g_strdup (child->path));
+        }
+      else
+        dconf_engine_watch_node_take_rules (child, rules);
+    }
 }
 
 /**
- * Decrements the reference count for the subscription to @path, or
- * removes it if the new value is 0. The count must exist and be greater
- * than 0.
- * Returns the new reference count, or 0 if it does not exist.
+ * Gives match rules to the topmost watched paths below @node, adding
+ * their paths to @rules.
+ */
+static void
+dconf_engine_watch_node_give_rules (DConfEngineWatchNode *node,
+                                    GPtrArray            *rules)
+{
+  GHashTableIter iter;
+  gpointer child_p;
+
+  if (node->children == NULL)
+    return;
+
+  g_hash_table_iter_init (&iter, node->children);
+  while (g_hash_table_iter_next (&iter, NULL, &child_p))
+    {
+      DConfEngineWatchNode *child = child_p;
+
+      if (child->count > 0)
+        {
+          child->has_rule = TRUE;
+          g_ptr_array_add (rules, g_strdup (child->path));
+        }
+      else
+        dconf_engine_watch_node_give_rules (child, rules);
+    }
+}
+
+/**
+ * Adds a subscription to @path.  The paths that need a new match rule
+ * are added to @add_rules and those that no longer need theirs are
+ * added to @remove_rules.
+ *
+ * Returns the new number of subscriptions to @path.
  */
 static guint
-dconf_engine_dec_subscriptions (GHashTable  *counts,
-                                const gchar *path)
-{
-  guint old_count = GPOINTER_TO_UINT (g_hash_table_lookup (counts, path));
-  g_assert (old_count > 0);
-  guint new_count = old_count - 1;
-  if (new_count == 0)
-    g_hash_table_remove (counts, path);
-  else
-    g_hash_table_replace (counts, g_strdup (path), GUINT_TO_POINTER (new_count));
-  return new_count;
+dconf_engine_add_subscription (DConfEngine *engine,
+                               const gchar *path,
+                               GPtrArray   *add_rules,
+                               GPtrArray   *remove_rules)
+{
+  DConfEngineWatchNode *node;
+
+  node = dconf_engine_watch_node_lookup (engine->watches, path, TRUE);
+
+  // Detect overflows
+  g_assert (node->count < G_MAXUINT);
+
+  if (node->count++ == 0 && !dconf_engine_watch_node_is_covered (node))
+    {
+      node->has_rule = TRUE;
+      g_ptr_array_add (add_rules, g_strdup (path));
+      dconf_engine_watch_node_take_rules (node, remove_rules);
+    }
+
+  return node->count;
 }
 
 /**
- * Returns the reference count for the subscription to @path, or 0 if it
- * does not exist.
+ * Removes a subscription to @path, which must exist.  The paths that
+ * need a new match rule are added to @add_rules and those that no longer
+ * need theirs are added to @remove_rules.
+ *
+ * Returns the new number of subscriptions to @path.
  */
 static guint
-dconf_engine_count_subscriptions (GHashTable  *counts,
-                                  const gchar *path)
+dconf_engine_remove_subscription (DConfEngine *engine,
+                                  const gchar *path,
+                                  GPtrArray   *add_rules,
+                                  GPtrArray   *remove_rules)
 {
-  return GPOINTER_TO_UINT (g_hash_table_lookup (counts, path));
+  DConfEngineWatchNode *node;
+  guint count;
+
+  node = dconf_engine_watch_node_lookup (engine->watches, path, FALSE);
+
+  // Client code cannot unsubscribe if it is not subscribed
+  g_assert (node != NULL && node->count > 0);
+
+  count = --node->count;
+
+  if (count == 0 && node->has_rule)
+    {
+      node->has_rule = FALSE;
+      dconf_engine_watch_node_give_rules (node, add_rules);
+      g_ptr_array_add (remove_rules, g_strdup (path));
+    }
+
+  dconf_engine_watch_node_prune (node);
+
+  return count;
 }
 
 /**
@@ -310,11 +559,216 @@ dconf_engine_unlock_subscription_counts (DConfEngine *engine)
   g_mutex_unlock (&engine->subscription_count_lock);
 }
 
+static void
+dconf_engine_cache_value_unref (gpointer data)
+{
+  if (data != NULL)
+    g_variant_unref (data);
+}
+
+/* Must be called with the sources lock held, so that engine->state is
+ * stable.
+ */
+static gboolean
+dconf_engine_cache_lookup (DConfEngine  *engine,
+                           const gchar  *key,
+                           GVariant    **value)
+{
+  gpointer cached;
+  gboolean found;
+
+  g_mutex_lock (&engine->cache_lock);
+
+  if (engine->cache_state != engine->state)
+    {
+      g_hash_table_remove_all (engine->cache);
+      engine->cache_state = engine->state;
+    }
+
+  found = g_hash_table_lookup_extended (engine->cache, key, NULL, &cached);
+
+  if (found)
+    {
+      *value = cached ? g_variant_ref (cached) : NULL;
+      engine->cache_hits++;
+    }
+  else
+    engine->cache_misses++;
+
+  g_mutex_unlock (&engine->cache_lock);
+
+  return found;
+}
+
+static void
+dconf_engine_cache_insert (DConfEngine *engine,
+                           const gchar *key,
+                           GVariant    *value)
+{
+  g_mutex_lock (&engine->cache_lock);
+
+  /* Keep it simple: when we're full, start again. */
+  if (engine->cache_state != engine->state ||
+      g_hash_table_size (engine->cache) >= engine->cache_size)
+    {
+      g_hash_table_remove_all (engine->cache);
+      engine->cache_state = engine->state;
+    }
+
+  g_hash_table_insert (engine->cache, g_strdup (key), value ? g_variant_ref (value) : NULL);
+
+  g_mutex_unlock (&engine->cache_lock);
+}
+
+void
+dconf_engine_get_read_cache_stats (DConfEngine *engine,
+                                   guint64     *hits,
+                                   guint64     *misses)
+{
+  g_mutex_lock (&engine->cache_lock);
+  *hits = engine->cache_hits;
+  *misses = engine->cache_misses;
+  g_mutex_unlock (&engine->cache_lock);
+}
+
+typedef struct
+{
+  GBusType     bus_type;
+  const gchar *object_path;
+} DConfEngineSignalKey;
+
+static guint
+dconf_engine_signal_key_hash (gconstpointer data)
+{
+  const DConfEngineSignalKey *key = data;
+
+  return g_str_hash (key->object_path) ^ key->bus_type;
+}
+
+static gboolean
+dconf_engine_signal_key_equal (gconstpointer a_p,
+                               gconstpointer b_p)
+{
+  const DConfEngineSignalKey *a = a_p;
+  const DConfEngineSignalKey *b = b_p;
+
+  return a->bus_type == b->bus_type && g_str_equal (a->object_path, b->object_path);
+}
+
+static void
+dconf_engine_signal_key_free (gpointer data)
+{
+  DConfEngineSignalKey *key = data;
+
+  g_free ((gchar *) key->object_path);
+  g_slice_free (DConfEngineSignalKey, key);
+}
+
+/* Must be called with the signal index lock held for writing */
+static void
+dconf_engine_signal_index_add (DConfEngine *engine)
+{
+  gint i;
+
+  if (dconf_engine_signal_index == NULL)
+    dconf_engine_signal_index = g_hash_table_new_full (dconf_engine_signal_key_hash,
+                                                       dconf_engine_signal_key_equal,
+                                                       dconf_engine_signal_key_free,
+                                                       (GDestroyNotify) g_ptr_array_unref);
+
+  for (i = 0; i < engine->n_sources; i++)
+    {
+      DConfEngineSource *source = engine->sources[i];
+      DConfEngineSignalKey lookup = { source->bus_type, source->object_path };
+      GPtrArray *engines;
+
+      if (!source->bus_type)
+        continue;
+
+      engines = g_hash_table_lookup (dconf_engine_signal_index, &lookup);
+
+      if (engines == NULL)
+        {
+          DConfEngineSignalKey *key;
+
+          key = g_slice_new (DConfEngineSignalKey);
+          key->bus_type = source->bus_type;
+          key->object_path = g_strdup (source->object_path);
+
+          engines = g_ptr_array_new ();
+          g_hash_table_insert (dconf_engine_signal_index, key, engines);
+        }
+
+      /* Two sources of one engine may share a path.  The engine is
+       * always added last, so that is the only place to check.
+       */
+      else if (engines->pdata[engines->len - 1] == engine)
+        continue;
+
+      g_ptr_array_add (engines, engine);
+    }
+}
+
+/* Must be called with the signal index lock held for writing */
+static void
+dconf_engine_signal_index_remove (DConfEngine *engine)
+{
+  gint i;
+
+  for (i = 0; i < engine->n_sources; i++)
+    {
+      DConfEngineSource *source = engine->sources[i];
+      DConfEngineSignalKey lookup = { source->bus_type, source->object_path };
+      GPtrArray *engines;
+
+      if (!source->bus_type)
+        continue;
+
+      engines = g_hash_table_lookup (dconf_engine_signal_index, &lookup);
+
+      /* NULL if a previous source had the same path */
+      if (engines == NULL)
+        continue;
+
+      g_ptr_array_remove_fast (engines, engine);
+
+      if (engines->len == 0)
+        g_hash_table_remove (dconf_engine_signal_index, &lookup);
+    }
+}
+
+/* Returns a new reference on each of the engines that are interested
+ * in signals from @object_path on @bus_type, or NULL if there are none.
+ */
+static GPtrArray *
+dconf_engine_signal_index_lookup (GBusType     bus_type,
+                                  const gchar *object_path)
+{
+  DConfEngineSignalKey lookup = { bus_type, object_path };
+  GPtrArray *interested = NULL;
+  GPtrArray *engines;
+
+  g_rw_lock_reader_lock (&dconf_engine_signal_index_lock);
+
+  if (dconf_engine_signal_index != NULL &&
+      (engines = g_hash_table_lookup (dconf_engine_signal_index, &lookup)))
+    {
+      interested = g_ptr_array_copy (engines, (GCopyFunc) dconf_engine_ref, NULL);
+      g_ptr_array_set_free_func (interested, (GDestroyNotify) dconf_engine_unref);
+    }
+
+  g_rw_lock_reader_unlock (&dconf_engine_signal_index_lock);
+
+  return interested;
+}
+
 DConfEngine *
 dconf_engine_new (const gchar    *profile,
                   gpointer        user_data,
                   GDestroyNotify  free_func)
 {
+  const gchar *cache_size;
+  const gchar *depth;
   DConfEngine *engine;
 
   engine = g_slice_new0 (DConfEngine);
@@ -322,25 +776,46 @@ dconf_engine_new (const gchar    *profile,
   engine->free_func = free_func;
   engine->ref_count = 1;
 
-  g_mutex_init (&engine->sources_lock);
+  g_rw_lock_init (&engine->sources_lock);
   g_mutex_init (&engine->queue_lock);
   g_cond_init (&engine->queue_cond);
 
   engine->sources = dconf_engine_profile_open (profile, &engine->n_sources);
 
-  g_mutex_lock (&dconf_engine_global_lock);
-  dconf_engine_global_list = g_slist_prepend (dconf_engine_global_list, engine);
-  g_mutex_unlock (&dconf_engine_global_lock);
+  engine->max_in_flight = 1;
+  depth = g_getenv ("DCONF_FAST_WRITE_DEPTH");
+  if (depth != NULL)
+    {
+      guint64 value;
+
+      if (g_ascii_string_to_unsigned (depth, 10, 1, G_MAXUINT, &value, NULL))
+        engine->max_in_flight = value;
+      else
+        g_warning ("ignoring invalid DCONF_FAST_WRITE_DEPTH value '%s'", depth);
+    }
+
+  g_mutex_init (&engine->cache_lock);
+  cache_size = g_getenv ("DCONF_READ_CACHE_SIZE");
+  if (cache_size != NULL)
+    {
+      guint64 size;
+
+      if (g_ascii_string_to_unsigned (cache_size, 10, 0, G_MAXUINT, &size, NULL))
+        engine->cache_size = size;
+      else
+        g_warning ("ignoring invalid DCONF_READ_CACHE_SIZE value '%s'", cache_size);
+    }
+
+  if (engine->cache_size)
+    engine->cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                           (GDestroyNotify) dconf_engine_cache_value_unref);
 
   g_mutex_init (&engine->subscription_count_lock);
-  engine->establishing = g_hash_table_new_full (g_str_hash,
-                                                g_str_equal,
-                                                g_free,
-                                                NULL);
-  engine->active = g_hash_table_new_full (g_str_hash,
-                                          g_str_equal,
-                                          g_free,
-                                          NULL);
+  engine->watches = dconf_engine_watch_node_new (NULL, g_strdup ("/"));
+
+  g_rw_lock_writer_lock (&dconf_engine_signal_index_lock);
+  dconf_engine_signal_index_add (engine);
+  g_rw_lock_writer_unlock (&dconf_engine_signal_index_lock);
 
   return engine;
 }
@@ -360,40 +835,42 @@ dconf_engine_unref (DConfEngine *engine)
       /* We are about to drop the last reference, but there is a chance
        * that a signal may be happening at this very moment, causing the
        * engine to gain another reference (due to its position in the
-       * global engine list).
+       * signal index).
        *
        * Acquiring the lock here means that either we will remove this
-       * engine from the list first or we will notice the reference
+       * engine from the index first or we will notice the reference
        * count has increased (and skip the free).
        */
-      g_mutex_lock (&dconf_engine_global_lock);
+      g_rw_lock_writer_lock (&dconf_engine_signal_index_lock);
       if (engine->ref_count != 1)
         {
-          g_mutex_unlock (&dconf_engine_global_lock);
+          g_rw_lock_writer_unlock (&dconf_engine_signal_index_lock);
           goto again;
         }
-      dconf_engine_global_list = g_slist_remove (dconf_engine_global_list, engine);
-      g_mutex_unlock (&dconf_engine_global_lock);
+      dconf_engine_signal_index_remove (engine);
+      g_rw_lock_writer_unlock (&dconf_engine_signal_index_lock);
 
-      g_mutex_clear (&engine->sources_lock);
+      g_rw_lock_clear (&engine->sources_lock);
       g_mutex_clear (&engine->queue_lock);
       g_cond_clear (&engine->queue_cond);
 
-      g_free (engine->last_handled);
+      g_queue_clear_full (&engine->last_handled, g_free);
 
       g_clear_pointer (&engine->pending, dconf_changeset_unref);
-      g_clear_pointer (&engine->in_flight, dconf_changeset_unref);
+      g_queue_clear_full (&engine->in_flight, (GDestroyNotify) dconf_changeset_unref);
 
       for (i = 0; i < engine->n_sources; i++)
         dconf_engine_source_free (engine->sources[i]);
 
       g_free (engine->sources);
 
-      g_hash_table_unref (engine->establishing);
-      g_hash_table_unref (engine->active);
+      dconf_engine_watch_node_free (engine->watches);
 
       g_mutex_clear (&engine->subscription_count_lock);
 
+      g_clear_pointer (&engine->cache, g_hash_table_unref);
+      g_mutex_clear (&engine->cache_lock);
+
       if (engine->free_func)
         engine->free_func (engine->user_data);
 
@@ -424,10 +901,29 @@ dconf_engine_get_state (DConfEngine *engine)
   return state;
 }
 
+/* A key along with its gvdb hash, so that it only needs to be hashed
+ * once, no matter how many tables it gets looked up in.
+ */
+typedef struct
+{
+  const gchar *name;
+  guint        length;
+  guint32      hash;
+} DConfEngineKey;
+
+static void
+dconf_engine_key_init (DConfEngineKey *key,
+                       const gchar    *name)
+{
+  key->name = name;
+  key->hash = gvdb_table_hash_key (name, &key->length);
+}
+
 static gboolean
 dconf_engine_is_writable_internal (DConfEngine *engine,
                                    const gchar *key)
 {
+  DConfEngineKey hashed;
   gint i;
 
   /* We must check several things:
@@ -449,8 +945,11 @@ dconf_engine_is_writable_internal (DConfEngine *engine,
    * Either it is writable and therefore ignoring locks is the right
    * thing to do, or it's non-writable and we caught that case above.
    */
+  dconf_engine_key_init (&hashed, key);
+
   for (i = 1; i < engine->n_sources; i++)
-    if (engine->sources[i]->locks && gvdb_table_has_value (engine->sources[i]->locks, key))
+    if (engine->sources[i]->locks &&
+        gvdb_table_has_value_hashed (engine->sources[i]->locks, hashed.name, hashed.length, hashed.hash))
       return FALSE;
 
   return TRUE;
@@ -469,6 +968,26 @@ dconf_engine_is_writable (DConfEngine *engine,
   return writable;
 }
 
+typedef struct
+{
+  GHashTable  *set;
+  const gchar *path;
+} ListLocks;
+
+static void
+dconf_engine_list_locks_add (const gchar *name,
+                             gsize        length,
+                             gpointer     user_data)
+{
+  ListLocks *data = user_data;
+
+  /* It is not currently possible to lock dirs, so we don't (yet) have
+   * to check the other direction.
+   */
+  if (g_str_has_prefix (name, data->path))
+    g_hash_table_add (data->set, g_strndup (name, length));
+}
+
 gchar **
 dconf_engine_list_locks (DConfEngine *engine,
                          const gchar *path,
@@ -486,26 +1005,15 @@ dconf_engine_list_locks (DConfEngine *engine,
 
       if (engine->n_sources > 0 && engine->sources[0]->writable)
         {
-          gint i, j;
+          gint i;
 
           for (i = 1; i < engine->n_sources; i++)
             {
               if (engine->sources[i]->locks)
                 {
-                  strv = gvdb_table_get_names (engine->sources[i]->locks, NULL);
-
-                  for (j = 0; strv[j]; j++)
-                    {
-                      /* It is not currently possible to lock dirs, so we
-                       * don't (yet) have to check the other direction.
-                       */
-                      if (g_str_has_prefix (strv[j], path))
-                        g_hash_table_add (set, strv[j]);
-                      else
-                        g_free (strv[j]);
-                    }
-
-                  g_free (strv);
+                  ListLocks data = { set, path };
+
+                  gvdb_table_foreach_name (engine->sources[i]->locks, dconf_engine_list_locks_add, &data);
                 }
             }
         }
@@ -549,18 +1057,57 @@ dconf_engine_find_key_in_queue (const GQueue  *queue,
   return FALSE;
 }
 
-GVariant *
-dconf_engine_read (DConfEngine    *engine,
-                   DConfReadFlags  flags,
-                   const GQueue   *read_through,
-                   const gchar    *key)
+/* Must be called with the sources lock held.
+ *
+ * This is step 1 of the read process described in
+ * dconf_engine_read_internal() below, done for a number of keys at
+ * once.  Each table of locks is
+ * visited only once, regardless of the number of keys.
+ *
+ * Note: i > 0 (strictly).  Ignore locks for source #0.
+ */
+static void
+dconf_engine_find_lock_levels (DConfEngine          *engine,
+                               DConfReadFlags        flags,
+                               const DConfEngineKey *keys,
+                               gint                  n_keys,
+                               gint                 *lock_levels)
+{
+  gint i, j;
+
+  memset (lock_levels, 0, n_keys * sizeof (gint));
+
+  if (flags & DCONF_READ_USER_VALUE)
+    return;
+
+  /* We want the highest-index source with a lock, so go backwards and
+   * keep the first lock we see for each key.
+   */
+  for (i = engine->n_sources - 1; i > 0; i--)
+    if (engine->sources[i]->locks)
+      for (j = 0; j < n_keys; j++)
+        if (!lock_levels[j] &&
+            gvdb_table_has_value_hashed (engine->sources[i]->locks, keys[j].name, keys[j].length, keys[j].hash))
+          lock_levels[j] = i;
+}
+
+/* Must be called with the sources lock held.  If @queue_locked is TRUE
+ * then the caller also holds the queue lock, otherwise it will be taken
+ * here, if needed.
+ *
+ * @lock_level is the result of step 1 for @key.
+ */
+static GVariant *
+dconf_engine_read_internal (DConfEngine          *engine,
+                            DConfReadFlags        flags,
+                            const GQueue         *read_through,
+                            const DConfEngineKey *key,
+                            gint                  lock_level,
+                            gboolean              queue_locked)
 {
   GVariant *value = NULL;
-  gint lock_level = 0;
   gint i;
 
-  dconf_engine_acquire_sources (engine);
-
   /* There are a number of situations that this function has to deal
    * with and they interact in unusual ways.  We attempt to write the
    * rules for all cases here:
@@ -647,7 +1194,8 @@ dconf_engine_read (DConfEngine    *engine,
    *     'found_key' to TRUE and set 'value' to the value that we found
    *     (which will be NULL in the case of finding a reset request).
    *
-   *  3. check our pending and in-flight "fast" changes (in that order).
+   *  3. check our pending and in-flight "fast" changes (in that order,
+   *     and newest to oldest within the in-flight queue).
    *     This is only done if we have a writable source and no locks
    *     were found.  It is also only done if we did not find the key in
    *     the read_through.
@@ -670,17 +1218,7 @@ dconf_engine_read (DConfEngine    *engine,
    *     lower-level databases.
    */
 
-  /* Step 1.  Check for locks.
-   *
-   * Note: i > 0 (strictly).  Ignore locks for source #0.
-   */
-  if (~flags & DCONF_READ_USER_VALUE)
-    for (i = engine->n_sources - 1; i > 0; i--)
-      if (engine->sources[i]->locks && gvdb_table_has_value (engine->sources[i]->locks, key))
-        {
-          lock_level = i;
-          break;
-        }
+  /* Step 1 was already done by our caller. */
 
   /* Only do steps 2 to 4 if we have no locks and we have a writable source. */
   if (!lock_level && engine->n_sources != 0 && engine->sources[0]->writable)
@@ -697,32 +1235,35 @@ dconf_engine_read (DConfEngine    *engine,
 
       /* Step 2.  Check read_through. */
       if (!found_key && read_through)
-        found_key = dconf_engine_find_key_in_queue (read_through, key, &value);
+        found_key = dconf_engine_find_key_in_queue (read_through, key->name, &value);
 
       /* Step 3.  Check queued changes if we didn't find it in read_through.
        *
-       * NB: We may want to optimise this to avoid taking the lock in
-       * the case that we know both queues are empty.
+       * Don't bother taking the lock if we know both queues are empty.
        */
-      if (!found_key)
+      if (!found_key && (queue_locked || g_atomic_int_get (&engine->queue_length) != 0))
         {
-          dconf_engine_lock_queue (engine);
+          if (!queue_locked)
+            dconf_engine_lock_queue (engine);
+
+          GList *link;
 
           /* Check the pending first because those were submitted
            * more recently.
            */
           if (engine->pending != NULL)
-            found_key = dconf_changeset_get (engine->pending, key, &value);
+            found_key = dconf_changeset_get (engine->pending, key->name, &value);
 
-          if (!found_key && engine->in_flight != NULL)
-            found_key = dconf_changeset_get (engine->in_flight, key, &value);
+          for (link = engine->in_flight.tail; !found_key && link; link = link->prev)
+            found_key = dconf_changeset_get (link->data, key->name, &value);
 
-          dconf_engine_unlock_queue (engine);
+          if (!queue_locked)
+            dconf_engine_unlock_queue (engine);
         }
 
       /* Step 4.  Check the first source. */
       if (!found_key && engine->sources[0]->values)
-        value = gvdb_table_get_value (engine->sources[0]->values, key);
+        value = gvdb_table_get_value_hashed (engine->sources[0]->values, key->name, key->length, key->hash);
 
       /* We already checked source #0 (or ignored it, as appropriate).
        *
@@ -738,15 +1279,127 @@ dconf_engine_read (DConfEngine    *engine,
         if (engine->sources[i]->values == NULL)
           continue;
 
-        if ((value = gvdb_table_get_value (engine->sources[i]->values, key)))
+        if ((value = gvdb_table_get_value_hashed (engine->sources[i]->values, key->name, key->length, key->hash)))
           break;
       }
 
+  return value;
+}
+
+/* Only plain reads with no queued changes of any kind are cached.
+ * Anything in the queue will be reflected in the database (and
+ * therefore the state) by the time the queue is empty again.
+ */
+static gboolean
+dconf_engine_read_is_cacheable (DConfEngine    *engine,
+                                DConfReadFlags  flags,
+                                const GQueue   *read_through)
+{
+  return engine->cache != NULL && flags == DCONF_READ_FLAGS_NONE &&
+         (read_through == NULL || read_through->head == NULL) &&
+         g_atomic_int_get (&engine->queue_length) == 0;
+}
+
+GVariant *
+dconf_engine_read (DConfEngine    *engine,
+                   DConfReadFlags  flags,
+                   const GQueue   *read_through,
+                   const gchar    *key)
+{
+  DConfEngineKey hashed;
+  GVariant *value = NULL;
+  gboolean cacheable;
+  gint lock_level;
+
+  dconf_engine_acquire_sources (engine);
+
+  cacheable = dconf_engine_read_is_cacheable (engine, flags, read_through);
+
+  if (cacheable && dconf_engine_cache_lookup (engine, key, &value))
+    {
+      dconf_engine_release_sources (engine);
+      return value;
+    }
+
+  dconf_engine_key_init (&hashed, key);
+  dconf_engine_find_lock_levels (engine, flags, &hashed, 1, &lock_level);
+  value = dconf_engine_read_internal (engine, flags, read_through, &hashed, lock_level, FALSE);
+
+  if (cacheable)
+    dconf_engine_cache_insert (engine, key, value);
+
   dconf_engine_release_sources (engine);
 
   return value;
 }
 
+GVariant **
+dconf_engine_read_many (DConfEngine          *engine,
+                        DConfReadFlags        flags,
+                        const GQueue         *read_through,
+                        const gchar * const  *keys,
+                        gint                  n_keys)
+{
+  DConfEngineKey *missed_keys;
+  GVariant **values;
+  gint *missed_index;
+  gint *lock_levels;
+  gboolean cacheable;
+  gboolean queue_locked;
+  gint n_missed;
+  gint i;
+
+  values = g_new0 (GVariant *, n_keys);
+  missed_keys = g_new (DConfEngineKey, n_keys);
+  missed_index = g_new (gint, n_keys);
+  lock_levels = g_new (gint, n_keys);
+
+  /* Same as dconf_engine_read(), but with the locks only taken once
+   * for the entire batch.
+   */
+  dconf_engine_acquire_sources (engine);
+
+  cacheable = dconf_engine_read_is_cacheable (engine, flags, read_through);
+
+  n_missed = 0;
+  for (i = 0; i < n_keys; i++)
+    if (!cacheable || !dconf_engine_cache_lookup (engine, keys[i], &values[i]))
+      {
+        dconf_engine_key_init (&missed_keys[n_missed], keys[i]);
+        missed_index[n_missed] = i;
+        n_missed++;
+      }
+
+  dconf_engine_find_lock_levels (engine, flags, missed_keys, n_missed, lock_levels);
+
+  queue_locked = n_missed > 0 && g_atomic_int_get (&engine->queue_length) != 0;
+  if (queue_locked)
+    dconf_engine_lock_queue (engine);
+
+  for (i = 0; i < n_missed; i++)
+    {
+      GVariant *value;
+
+      value = dconf_engine_read_internal (engine, flags, read_through, &missed_keys[i], lock_levels[i], queue_locked);
+
+      if (cacheable)
+        dconf_engine_cache_insert (engine, missed_keys[i].name, value);
+
+      values[missed_index[i]] = value;
+    }
+
+  if (queue_locked)
+    dconf_engine_unlock_queue (engine);
+
+  dconf_engine_release_sources (engine);
+
+  g_free (lock_levels);
+  g_free (missed_index);
+  g_free (missed_keys);
+
+  return values;
+}
+
 gchar **
 dconf_engine_list (DConfEngine *engine,
                    const gchar *dir,
@@ -784,93 +1437,231 @@ dconf_engine_list (DConfEngine *engine,
       gchar **partial_list;
       gint j;
 
-      if (engine->sources[i]->values == NULL)
-        continue;
+      if (engine->sources[i]->values == NULL)
+        continue;
+
+      partial_list = gvdb_table_list (engine->sources[i]->values, dir);
+
+      if (partial_list != NULL)
+        {
+          for (j = 0; partial_list[j]; j++)
+            /* Steal the keys from the list. */
+            g_hash_table_add (results, partial_list[j]);
+
+          /* Free only the list. */
+          g_free (partial_list);
+        }
+    }
+
+  dconf_engine_release_sources (engine);
+
+  n_items = g_hash_table_size (results);
+  list = g_new (gchar *, n_items + 1);
+
+  i = 0;
+  g_hash_table_iter_init (&iter, results);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      g_hash_table_iter_steal (&iter);
+      list[i++] = key;
+    }
+  list[i] = NULL;
+  g_assert_cmpint (i, ==, n_items);
+
+  if (length)
+    *length = n_items;
+
+  g_hash_table_unref (results);
+
+  return list;
+}
+
+/* Must be called with the queue lock held.
+ *
+ * Checks if a queued change overrides the value of @key in source #0,
+ * either by setting it, resetting it or resetting one of its parents.
+ */
+static gboolean
+dconf_engine_key_is_queued (DConfEngine *engine,
+                            const gchar *key)
+{
+  GList *link;
+
+  if (engine->pending != NULL && dconf_changeset_get (engine->pending, key, NULL))
+    return TRUE;
+
+  for (link = engine->in_flight.head; link; link = link->next)
+    if (dconf_changeset_get (link->data, key, NULL))
+      return TRUE;
+
+  return FALSE;
+}
+
+typedef struct
+{
+  DConfEngine *engine;
+  GList       *in_flight;
+  GPtrArray   *keys;
+} QueuedKeysIndex;
+
+/* A #DConfChangesetPredicate that records each key that is given a
+ * value by the changeset, unless a newer queued changeset overrides it.
+ *
+ * in_flight is the link of the changeset being checked, or NULL when
+ * checking the pending changeset (which nothing can override).
+ */
+static gboolean
+dconf_engine_index_queued_key_predicate (const gchar *path,
+                                         GVariant    *value,
+                                         gpointer     user_data)
+{
+  QueuedKeysIndex *data = user_data;
+  GList *link;
+
+  if (value == NULL)
+    return TRUE;
+
+  if (data->in_flight != NULL)
+    {
+      if (data->engine->pending != NULL &&
+          dconf_changeset_get (data->engine->pending, path, NULL))
+        return TRUE;
+
+      for (link = data->in_flight->next; link; link = link->next)
+        if (dconf_changeset_get (link->data, path, NULL))
+          return TRUE;
+    }
+
+  g_ptr_array_add (data->keys, (gpointer) path);
+
+  return TRUE;
+}
+
+static gint
+dconf_engine_string_ptr_compare (gconstpointer a_p,
+                                 gconstpointer b_p)
+{
+  const gchar * const *a = a_p;
+  const gchar * const *b = b_p;
+
+  return strcmp (*a, *b);
+}
 
-      partial_list = gvdb_table_list (engine->sources[i]->values, dir);
+/* Must be called with the queue lock held.
+ *
+ * Returns a sorted array of the keys that the queued changes give a
+ * value to.  Since all keys below a dir sort together, checking if
+ * anything is queued below a dir is then a binary search.
+ *
+ * The strings belong to the queued changesets, so the array must be
+ * freed before the queue lock is released.
+ */
+static GPtrArray *
+dconf_engine_index_queued_keys (DConfEngine *engine)
+{
+  QueuedKeysIndex data = { engine, NULL, g_ptr_array_new () };
+  GList *link;
 
-      if (partial_list != NULL)
-        {
-          for (j = 0; partial_list[j]; j++)
-            /* Steal the keys from the list. */
-            g_hash_table_add (results, partial_list[j]);
+  if (engine->pending != NULL)
+    dconf_changeset_all (engine->pending, dconf_engine_index_queued_key_predicate, &data);
 
-          /* Free only the list. */
-          g_free (partial_list);
-        }
+  for (link = engine->in_flight.tail; link; link = link->prev)
+    {
+      data.in_flight = link;
+      dconf_changeset_all (link->data, dconf_engine_index_queued_key_predicate, &data);
     }
 
-  dconf_engine_release_sources (engine);
+  g_ptr_array_sort (data.keys, dconf_engine_string_ptr_compare);
 
-  n_items = g_hash_table_size (results);
-  list = g_new (gchar *, n_items + 1);
+  return data.keys;
+}
 
-  i = 0;
-  g_hash_table_iter_init (&iter, results);
-  while (g_hash_table_iter_next (&iter, &key, NULL))
-    {
-      g_hash_table_iter_steal (&iter);
-      list[i++] = key;
-    }
-  list[i] = NULL;
-  g_assert_cmpint (i, ==, n_items);
+static gboolean
+dconf_engine_queued_keys_have_prefix (GPtrArray   *keys,
+                                      const gchar *dir)
+{
+  guint lo = 0, hi = keys->len;
 
-  if (length)
-    *length = n_items;
+  /* Find the first key that is not less than dir */
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
 
-  g_hash_table_unref (results);
+      if (strcmp (keys->pdata[mid], dir) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
 
-  return list;
+  return lo < keys->len && g_str_has_prefix (keys->pdata[lo], dir);
 }
 
+/* Must be called with the sources lock and the queue lock held.
+ *
+ * Walks the 'L' entries of source #0 below @dir looking for a key that
+ * has not been overridden by a queued change.
+ */
 static gboolean
-dconf_engine_dir_has_writable_contents (DConfEngine *engine,
-                                        const gchar *dir)
+dconf_engine_table_dir_has_writable_contents (DConfEngine *engine,
+                                              GvdbTable   *table,
+                                              const gchar *dir)
 {
-  DConfChangeset *database;
-  GHashTable *current_state;
+  gboolean result = FALSE;
+  gchar **children;
+  gint i;
 
-  /* Read the on disk state */
-  if (engine->n_sources == 0 || !engine->sources[0]->writable)
-    // If there are no writable sources, there won't be any pending writes either
-    return FALSE;
+  children = gvdb_table_list (table, dir);
 
-  dconf_engine_acquire_sources (engine);
-  database = dconf_gvdb_utils_changeset_from_table (engine->sources[0]->values);
-  dconf_engine_release_sources (engine);
+  if (children == NULL)
+    return FALSE;
 
-  /* Apply pending and in_flight changes to the on disk state */
-  dconf_engine_lock_queue (engine);
+  for (i = 0; !result && children[i]; i++)
+    {
+      gchar *path = g_strconcat (dir, children[i], NULL);
 
-  if (engine->in_flight != NULL)
-    dconf_changeset_change (database, engine->in_flight);
+      if (dconf_is_dir (path, NULL))
+        result = dconf_engine_table_dir_has_writable_contents (engine, table, path);
+      else
+        result = gvdb_table_has_value (table, path) && !dconf_engine_key_is_queued (engine, path);
 
-  if (engine->pending != NULL)
-    {
-      /**
-       * We don't want to seal the pending changeset because it may still be changed,
-       * and sealing the changeset would be a side effect of passing engine->pending
-       * directly into dconf_changeset_change.
-       */
-      DConfChangeset *changes = dconf_changeset_filter_changes (database, engine->pending);
-      if (changes != NULL)
-        {
-          dconf_changeset_change (database, changes);
-          dconf_changeset_unref (changes);
-        }
+      g_free (path);
     }
 
-  dconf_engine_unlock_queue (engine);
-
-  /* Check if there are writable contents at the given directory in the current state */
-  current_state = dconf_gvdb_utils_table_from_changeset (database);
-  gboolean result = g_hash_table_contains (current_state, dir);
+  g_strfreev (children);
 
-  g_hash_table_unref (current_state);
-  dconf_changeset_unref (database);
   return result;
 }
 
+/* Must be called with the sources lock and the queue lock held, and
+ * with a writable source #0.
+ *
+ * Rather than building the entire current state of the database, we
+ * only look at the parts of it that are below @dir:
+ *
+ *   - a key set by the pending changeset
+ *
+ *   - a key set by an in-flight changeset and not overridden by the
+ *     pending one or a newer in-flight one
+ *
+ *   - a key in the on-disk state that is not overridden by either
+ *
+ * The first two are answered by @queued_keys, as returned by
+ * dconf_engine_index_queued_keys().
+ */
+static gboolean
+dconf_engine_dir_has_writable_contents (DConfEngine *engine,
+                                        GPtrArray   *queued_keys,
+                                        const gchar *dir)
+{
+  if (dconf_engine_queued_keys_have_prefix (queued_keys, dir))
+    return TRUE;
+
+  if (engine->sources[0]->values != NULL)
+    return dconf_engine_table_dir_has_writable_contents (engine, engine->sources[0]->values, dir);
+
+  return FALSE;
+}
+
 typedef void (* DConfEngineCallHandleCallback) (DConfEngine  *engine,
                                                 gpointer      handle,
                                                 GVariant     *parameter,
@@ -975,6 +1766,8 @@ dconf_engine_watch_established (DConfEngine  *engine,
     /* more on the way... */
     return;
 
+  g_debug ("watch_established: \"%s\"", ow->path);
+
   if (ow->state != dconf_engine_get_state (engine))
     {
       const gchar * const changes[] = { "", NULL };
@@ -990,103 +1783,137 @@ dconf_engine_watch_established (DConfEngine  *engine,
       dconf_engine_change_notify (engine, ow->path, changes, NULL, FALSE, NULL, engine->user_data);
     }
 
-  dconf_engine_lock_subscription_counts (engine);
-  guint num_establishing = dconf_engine_count_subscriptions (engine->establishing,
-                                                             ow->path);
-  g_debug ("watch_established: \"%s\" (establishing: %d)", ow->path, num_establishing);
-  if (num_establishing > 0)
-    // Subscription(s): establishing -> active
-    dconf_engine_move_subscriptions (engine->establishing,
-                                     engine->active,
-                                     ow->path);
-
-  dconf_engine_unlock_subscription_counts (engine);
   g_clear_pointer (&ow->path, g_free);
   dconf_engine_call_handle_free (handle);
 }
 
+/* Sends @method_name for the match rule of @path to each source.  If
+ * @handle is non-NULL, its pending count must be set up by the caller.
+ */
+static void
+dconf_engine_send_match_rule_fast (DConfEngine           *engine,
+                                   const gchar           *method_name,
+                                   const gchar           *path,
+                                   DConfEngineCallHandle *handle)
+{
+  gint i;
+
+  for (i = 0; i < engine->n_sources; i++)
+    if (engine->sources[i]->bus_type)
+      dconf_engine_dbus_call_async_func (engine->sources[i]->bus_type, "org.freedesktop.DBus",
+                                         "/org/freedesktop/DBus", "org.freedesktop.DBus", method_name,
+                                         dconf_engine_make_match_rule (engine->sources[i], path),
+                                         handle, NULL);
+}
+
+/* Sends the match rule changes collected by dconf_engine_add_subscription()
+ * or dconf_engine_remove_subscription(), new rules first.
+ *
+ * If @watched is non-NULL and gets a new rule then its request is
+ * tracked so that we can detect changes made while it is on the wire.
+ * Any other new rules are for paths that are already covered by a rule
+ * that is only removed after them, so they need no such check.
+ */
+static void
+dconf_engine_send_match_rules_fast (DConfEngine *engine,
+                                    const gchar *watched,
+                                    GPtrArray   *add_rules,
+                                    GPtrArray   *remove_rules)
+{
+  guint i;
+
+  for (i = 0; i < add_rules->len; i++)
+    {
+      const gchar *path = add_rules->pdata[i];
+      OutstandingWatch *ow;
+      gint j;
+
+      if (watched == NULL || !g_str_equal (path, watched))
+        {
+          dconf_engine_send_match_rule_fast (engine, "AddMatch", path, NULL);
+          continue;
+        }
+
+      /* It's possible (although rare) that the dconf database could change
+       * while our match rule is on the wire.
+       *
+       * Since we returned immediately (suggesting to the user that the
+       * watch was already established) we could have a race.
+       *
+       * To deal with this, we use the current state counter to ensure that nothing
+       * changes while the watch requests are on the wire.
+       */
+      ow = dconf_engine_call_handle_new (engine, dconf_engine_watch_established,
+                                         G_VARIANT_TYPE_UNIT, sizeof (OutstandingWatch));
+      ow->state = dconf_engine_get_state (engine);
+      ow->path = g_strdup (path);
+
+      /* We start getting async calls returned as soon as we start dispatching them,
+       * so we must not touch the 'ow' struct after we send the first one.
+       */
+      for (j = 0; j < engine->n_sources; j++)
+        if (engine->sources[j]->bus_type)
+          ow->pending++;
+
+      if (ow->pending == 0)
+        {
+          g_free (ow->path);
+          dconf_engine_call_handle_free (&ow->handle);
+          continue;
+        }
+
+      dconf_engine_send_match_rule_fast (engine, "AddMatch", path, &ow->handle);
+    }
+
+  for (i = 0; i < remove_rules->len; i++)
+    dconf_engine_send_match_rule_fast (engine, "RemoveMatch", remove_rules->pdata[i], NULL);
+}
+
 void
 dconf_engine_watch_fast (DConfEngine *engine,
                          const gchar *path)
 {
-  dconf_engine_lock_subscription_counts (engine);
-  guint num_establishing = dconf_engine_count_subscriptions (engine->establishing, path);
-  guint num_active = dconf_engine_count_subscriptions (engine->active, path);
-  g_debug ("watch_fast: \"%s\" (establishing: %d, active: %d)", path, num_establishing, num_active);
-  if (num_active > 0)
-    // Subscription: inactive -> active
-    dconf_engine_inc_subscriptions (engine->active, path);
-  else
-    // Subscription: inactive -> establishing
-    num_establishing = dconf_engine_inc_subscriptions (engine->establishing,
-                                                       path);
-  dconf_engine_unlock_subscription_counts (engine);
-  if (num_establishing > 1 || num_active > 0)
-    return;
+  GPtrArray *add_rules, *remove_rules;
+  guint count;
 
-  OutstandingWatch *ow;
-  gint i;
+  add_rules = g_ptr_array_new_with_free_func (g_free);
+  remove_rules = g_ptr_array_new_with_free_func (g_free);
 
-  if (engine->n_sources == 0)
-    return;
+  dconf_engine_lock_subscription_counts (engine);
+  count = dconf_engine_add_subscription (engine, path, add_rules, remove_rules);
+  dconf_engine_unlock_subscription_counts (engine);
 
-  /* It's possible (although rare) that the dconf database could change
-   * while our match rule is on the wire.
-   *
-   * Since we returned immediately (suggesting to the user that the
-   * watch was already established) we could have a race.
-   *
-   * To deal with this, we use the current state counter to ensure that nothing
-   * changes while the watch requests are on the wire.
-   */
-  ow = dconf_engine_call_handle_new (engine, dconf_engine_watch_established,
-                                     G_VARIANT_TYPE_UNIT, sizeof (OutstandingWatch));
-  ow->state = dconf_engine_get_state (engine);
-  ow->path = g_strdup (path);
+  g_debug ("watch_fast: \"%s\" (subscriptions: %u, new rules: %u, removed rules: %u)",
+           path, count - 1, add_rules->len, remove_rules->len);
 
-  /* We start getting async calls returned as soon as we start dispatching them,
-   * so we must not touch the 'ow' struct after we send the first one.
-   */
-  for (i = 0; i < engine->n_sources; i++)
-    if (engine->sources[i]->bus_type)
-      ow->pending++;
+  if (engine->n_sources != 0)
+    dconf_engine_send_match_rules_fast (engine, path, add_rules, remove_rules);
 
-  for (i = 0; i < engine->n_sources; i++)
-    if (engine->sources[i]->bus_type)
-      dconf_engine_dbus_call_async_func (engine->sources[i]->bus_type, "org.freedesktop.DBus",
-                                         "/org/freedesktop/DBus", "org.freedesktop.DBus", "AddMatch",
-                                         dconf_engine_make_match_rule (engine->sources[i], path),
-                                         &ow->handle, NULL);
+  g_ptr_array_unref (add_rules);
+  g_ptr_array_unref (remove_rules);
 }
 
 void
 dconf_engine_unwatch_fast (DConfEngine *engine,
                            const gchar *path)
 {
-  dconf_engine_lock_subscription_counts (engine);
-  guint num_active = dconf_engine_count_subscriptions (engine->active, path);
-  guint num_establishing = dconf_engine_count_subscriptions (engine->establishing, path);
-  gint i;
-  g_debug ("unwatch_fast: \"%s\" (active: %d, establishing: %d)", path, num_active, num_establishing);
+  GPtrArray *add_rules, *remove_rules;
+  guint count;
 
-  // Client code cannot unsubscribe if it is not subscribed
-  g_assert (num_active > 0 || num_establishing > 0);
-  if (num_active == 0)
-    // Subscription: establishing -> inactive
-    num_establishing = dconf_engine_dec_subscriptions (engine->establishing, path);
-  else
-    // Subscription: active -> inactive
-    num_active = dconf_engine_dec_subscriptions (engine->active, path);
+  add_rules = g_ptr_array_new_with_free_func (g_free);
+  remove_rules = g_ptr_array_new_with_free_func (g_free);
 
+  dconf_engine_lock_subscription_counts (engine);
+  count = dconf_engine_remove_subscription (engine, path, add_rules, remove_rules);
   dconf_engine_unlock_subscription_counts (engine);
-  if (num_active > 0 || num_establishing > 0)
-    return;
 
-  for (i = 0; i < engine->n_sources; i++)
-    if (engine->sources[i]->bus_type)
-      dconf_engine_dbus_call_async_func (engine->sources[i]->bus_type, "org.freedesktop.DBus",
-                                         "/org/freedesktop/DBus", "org.freedesktop.DBus", "RemoveMatch",
-                                         dconf_engine_make_match_rule (engine->sources[i], path), NULL, NULL);
+  g_debug ("unwatch_fast: \"%s\" (subscriptions: %u, new rules: %u, removed rules: %u)",
+           path, count + 1, add_rules->len, remove_rules->len);
+
+  dconf_engine_send_match_rules_fast (engine, NULL, add_rules, remove_rules);
+
+  g_ptr_array_unref (add_rules);
+  g_ptr_array_unref (remove_rules);
 }
 
 static void
@@ -1120,28 +1947,60 @@ dconf_engine_handle_match_rule_sync (DConfEngine *engine,
     }
 }
 
+static void
+dconf_engine_send_match_rules_sync (DConfEngine *engine,
+                                    GPtrArray   *add_rules,
+                                    GPtrArray   *remove_rules)
+{
+  guint i;
+
+  for (i = 0; i < add_rules->len; i++)
+    dconf_engine_handle_match_rule_sync (engine, "AddMatch", add_rules->pdata[i]);
+
+  for (i = 0; i < remove_rules->len; i++)
+    dconf_engine_handle_match_rule_sync (engine, "RemoveMatch", remove_rules->pdata[i]);
+}
+
 void
 dconf_engine_watch_sync (DConfEngine *engine,
                          const gchar *path)
 {
+  GPtrArray *add_rules, *remove_rules;
+  guint count;
+
+  add_rules = g_ptr_array_new_with_free_func (g_free);
+  remove_rules = g_ptr_array_new_with_free_func (g_free);
+
   dconf_engine_lock_subscription_counts (engine);
-  guint num_active = dconf_engine_inc_subscriptions (engine->active, path);
+  count = dconf_engine_add_subscription (engine, path, add_rules, remove_rules);
   dconf_engine_unlock_subscription_counts (engine);
-  g_debug ("watch_sync: \"%s\" (active: %d)", path, num_active - 1);
-  if (num_active == 1)
-    dconf_engine_handle_match_rule_sync (engine, "AddMatch", path);
+
+  g_debug ("watch_sync: \"%s\" (subscriptions: %u)", path, count - 1);
+  dconf_engine_send_match_rules_sync (engine, add_rules, remove_rules);
+
+  g_ptr_array_unref (add_rules);
+  g_ptr_array_unref (remove_rules);
 }
 
 void
 dconf_engine_unwatch_sync (DConfEngine *engine,
                            const gchar *path)
 {
+  GPtrArray *add_rules, *remove_rules;
+  guint count;
+
+  add_rules = g_ptr_array_new_with_free_func (g_free);
+  remove_rules = g_ptr_array_new_with_free_func (g_free);
+
   dconf_engine_lock_subscription_counts (engine);
-  guint num_active = dconf_engine_dec_subscriptions (engine->active, path);
+  count = dconf_engine_remove_subscription (engine, path, add_rules, remove_rules);
   dconf_engine_unlock_subscription_counts (engine);
-  g_debug ("unwatch_sync: \"%s\" (active: %d)", path, num_active + 1);
-  if (num_active == 0)
-    dconf_engine_handle_match_rule_sync (engine, "RemoveMatch", path);
+
+  g_debug ("unwatch_sync: \"%s\" (subscriptions: %u)", path, count + 1);
+  dconf_engine_send_match_rules_sync (engine, add_rules, remove_rules);
+
+  g_ptr_array_unref (add_rules);
+  g_ptr_array_unref (remove_rules);
 }
 
 typedef struct
@@ -1164,12 +2023,12 @@ dconf_engine_prepare_change (DConfEngine     *engine,
                                   (GDestroyNotify) g_variant_unref, g_variant_ref_sink (serialised));
 }
 
-/* This function promotes the pending changeset to become the in-flight
+/* This function promotes the pending changeset to become an in-flight
  * changeset by sending the appropriate D-Bus message.
  *
  * Of course, this is only possible when there is a pending changeset
- * and no changeset is in-flight already. For this reason, this function
- * gets called in two situations:
+ * and fewer than max_in_flight changesets are in-flight already. For
+ * this reason, this function gets called in two situations:
  *
  *   - when there is a new pending changeset (due to an API call)
  *
@@ -1178,32 +2037,131 @@ dconf_engine_prepare_change (DConfEngine     *engine,
  */
 static void dconf_engine_manage_queue (DConfEngine *engine);
 
-/**
- * a #DConfChangesetPredicate which determines whether the given path and
- * value is already present in the given engine. "Already present" means
+typedef struct
+{
+  DConfEngine *engine;
+  GPtrArray   *queued_keys;
+} ChangesetHasNoEffect;
+
+/* Must be called with the sources lock and the queue lock held, and
+ * with a writable source #0.
+ *
+ * Equivalent to comparing the result of a DCONF_READ_USER_VALUE read
+ * of @key with @new_value, but without taking any locks and, where
+ * possible, without deserialising the current value.
+ */
+static gboolean
+dconf_engine_key_has_value (DConfEngine          *engine,
+                            const DConfEngineKey *key,
+                            GVariant             *new_value)
+{
+  GVariant *current_value = NULL;
+  const GVariantType *type;
+  gconstpointer data;
+  guint64 scratch;
+  gboolean found;
+  gboolean equal;
+  GList *link;
+  gsize size;
+
+  /* Same order as step 3 of dconf_engine_read_internal() */
+  found = engine->pending != NULL && dconf_changeset_get (engine->pending, key->name, &current_value);
+
+  for (link = engine->in_flight.tail; !found && link; link = link->prev)
+    found = dconf_changeset_get (link->data, key->name, &current_value);
+
+  if (!found && engine->sources[0]->values != NULL &&
+      gvdb_table_peek_value_hashed (engine->sources[0]->values, key->name, key->length, key->hash,
+                                    &type, &data, &size, &scratch, sizeof scratch))
+    {
+      if (new_value == NULL)
+        return FALSE;
+
+      /* Comparing the serialised data is only valid if @new_value is in
+       * normal form, since equal values can be serialised differently
+       * otherwise.
+       */
+      if (data != NULL && g_variant_is_normal_form (new_value))
+        return g_variant_type_equal (type, g_variant_get_type (new_value)) &&
+               size == g_variant_get_size (new_value) &&
+               (size == 0 || memcmp (data, g_variant_get_data (new_value), size) == 0);
+
+      /* Not directly comparable (eg: byteswapped container) */
+      current_value = gvdb_table_get_value_hashed (engine->sources[0]->values, key->name, key->length, key->hash);
+    }
+
+  equal = (current_value == NULL && new_value == NULL) ||
+          (current_value != NULL && new_value != NULL && g_variant_equal (current_value, new_value));
+
+  if (current_value)
+    g_variant_unref (current_value);
+
+  return equal;
+}
+
+/* A #DConfChangesetPredicate which determines whether the given path
+ * and value is already present in the engine. "Already present" means
  * that setting that path to that value would have no effect on the
  * engine, including for directory resets.
  */
 static gboolean
 dconf_engine_path_has_value_predicate (const gchar *path,
-                                      GVariant *new_value,
-                                      gpointer user_data)
+                                      GVariant    *new_value,
+                                      gpointer     user_data)
 {
-  DConfEngine *engine = user_data;
+  ChangesetHasNoEffect *data = user_data;
+  DConfEngineKey key;
 
   // Path reset are handled specially
   if (g_str_has_suffix (path, "/"))
-    return !dconf_engine_dir_has_writable_contents (engine, path);
+    {
+      if (data->queued_keys == NULL)
+        data->queued_keys = dconf_engine_index_queued_keys (data->engine);
+
+      return !dconf_engine_dir_has_writable_contents (data->engine, data->queued_keys, path);
+    }
+
+  dconf_engine_key_init (&key, path);
+
+  return dconf_engine_key_has_value (data->engine, &key, new_value);
+}
+
+static gboolean
+dconf_engine_is_reset_predicate (const gchar *path,
+                                 GVariant    *value,
+                                 gpointer     user_data)
+{
+  return value == NULL;
+}
 
-  g_autoptr(GVariant) current_value = dconf_engine_read (
-    engine,
-    DCONF_READ_USER_VALUE,
-    NULL,
-    path
-  );
-  return ((current_value == NULL && new_value == NULL) ||
-          (current_value != NULL && new_value != NULL &&
-           g_variant_equal (current_value, new_value)));
+/* Checks if applying @changeset would leave the user values unchanged.
+ *
+ * The locks are taken only once for the whole changeset and the index
+ * of queued keys is only built if there is a dir reset.
+ */
+static gboolean
+dconf_engine_changeset_has_no_effect (DConfEngine    *engine,
+                                      DConfChangeset *changeset)
+{
+  ChangesetHasNoEffect data = { engine, NULL };
+  gboolean result;
+
+  /* Without a writable source every user value is unset */
+  if (engine->n_sources == 0 || !engine->sources[0]->writable)
+    return dconf_changeset_all (changeset, dconf_engine_is_reset_predicate, NULL);
+
+  dconf_engine_acquire_sources (engine);
+  dconf_engine_lock_queue (engine);
+
+  result = dconf_changeset_all (changeset, dconf_engine_path_has_value_predicate, &data);
+
+  if (data.queued_keys)
+    g_ptr_array_unref (data.queued_keys);
+
+  dconf_engine_unlock_queue (engine);
+  dconf_engine_release_sources (engine);
+
+  return result;
 }
 
 static void
@@ -1225,12 +2183,12 @@ dconf_engine_change_completed (DConfEngine  *engine,
                                const GError *error)
 {
   OutstandingChange *oc = handle;
-  DConfChangeset *expected;
 
   dconf_engine_lock_queue (engine);
 
-  expected = g_steal_pointer (&engine->in_flight);
-  g_assert (expected && oc->change == expected);
+  /* The service replies in order, but we don't depend on it */
+  if (!g_queue_remove (&engine->in_flight, oc->change))
+    g_assert_not_reached ();
 
   /* Another request could be sent now. Check for pending changes. */
   dconf_engine_manage_queue (engine);
@@ -1250,10 +2208,19 @@ dconf_engine_change_completed (DConfEngine  *engine,
        * the same tag as on the change notification signal.  Record that
        * tag so that we can ignore the signal when it comes.
        *
+       * With more than one request in flight, several replies can
+       * arrive before the first of the corresponding signals, so we
+       * remember as many tags as there can be requests in flight.
+       *
        * last_handled is only ever touched from the worker thread
        */
-      g_free (engine->last_handled);
-      g_variant_get (reply, "(s)", &engine->last_handled);
+      gchar *tag;
+
+      g_variant_get (reply, "(s)", &tag);
+      g_queue_push_tail (&engine->last_handled, tag);
+
+      while (engine->last_handled.length > engine->max_in_flight)
+        g_free (g_queue_pop_head (&engine->last_handled));
     }
 
   if (error)
@@ -1276,7 +2243,7 @@ dconf_engine_change_completed (DConfEngine  *engine,
 static void
 dconf_engine_manage_queue (DConfEngine *engine)
 {
-  if (engine->pending != NULL && engine->in_flight == NULL)
+  if (engine->pending != NULL && engine->in_flight.length < engine->max_in_flight)
     {
       OutstandingChange *oc;
       GVariant *parameters;
@@ -1284,8 +2251,9 @@ dconf_engine_manage_queue (DConfEngine *engine)
       oc = dconf_engine_call_handle_new (engine, dconf_engine_change_completed,
                                          G_VARIANT_TYPE ("(s)"), sizeof (OutstandingChange));
 
-      oc->change = engine->in_flight = g_steal_pointer (&engine->pending);
-      dconf_changeset_seal (engine->in_flight);
+      oc->change = g_steal_pointer (&engine->pending);
+      dconf_changeset_seal (oc->change);
+      g_queue_push_tail (&engine->in_flight, oc->change);
 
       parameters = dconf_engine_prepare_change (engine, oc->change);
 
@@ -1296,7 +2264,12 @@ dconf_engine_manage_queue (DConfEngine *engine)
                                          parameters, &oc->handle, NULL);
     }
 
-  if (engine->in_flight == NULL)
+  /* All changes to the queue pass through here, so this is the place
+   * to update the length seen by readers.
+   */
+  g_atomic_int_set (&engine->queue_length, (engine->pending != NULL) + engine->in_flight.length);
+
+  if (engine->in_flight.length == 0)
     {
       /* The in-flight queue should not be empty if we have changes
        * pending...
@@ -1351,9 +2324,7 @@ dconf_engine_change_fast (DConfEngine     *engine,
   if (dconf_changeset_is_empty (changeset))
     return TRUE;
 
-  gboolean has_no_effect = dconf_changeset_all (changeset,
-                                                dconf_engine_path_has_value_predicate,
-                                                engine);
+  gboolean has_no_effect = dconf_engine_changeset_has_no_effect (engine, changeset);
 
   if (!dconf_engine_changeset_changes_only_writable_keys (engine, changeset, error))
     return FALSE;
@@ -1371,9 +2342,10 @@ dconf_engine_change_fast (DConfEngine     *engine,
 
   dconf_changeset_change (engine->pending, changeset);
 
-  /* There might be no in-flight request yet, so we try to manage the
-   * queue right away in order to try to promote pending changes there
-   * (which causes the D-Bus message to actually be sent). */
+  /* There might be room for another in-flight request, so we try to
+   * manage the queue right away in order to try to promote pending
+   * changes there (which causes the D-Bus message to actually be
+   * sent). */
   dconf_engine_manage_queue (engine);
 
   dconf_engine_unlock_queue (engine);
@@ -1425,23 +2397,78 @@ dconf_engine_change_sync (DConfEngine     *engine,
   return TRUE;
 }
 
-static gboolean
-dconf_engine_is_interested_in_signal (DConfEngine *engine,
-                                      GBusType     bus_type,
-                                      const gchar *sender,
-                                      const gchar *path)
+typedef struct
 {
-  gint i;
+  DConfEngineCallHandle handle;
 
-  for (i = 0; i < engine->n_sources; i++)
+  DConfChangeset            *change;
+  DConfEngineChangeCallback  callback;
+  gpointer                   user_data;
+} OutstandingAsyncChange;
+
+static void
+dconf_engine_change_async_completed (DConfEngine  *engine,
+                                     gpointer      handle,
+                                     GVariant     *reply,
+                                     const GError *error)
+{
+  OutstandingAsyncChange *oac = handle;
+  const gchar *tag = NULL;
+
+  if (reply)
+    g_variant_get (reply, "(&s)", &tag);
+
+  (* oac->callback) (engine, tag, error, oac->user_data);
+
+  dconf_changeset_unref (oac->change);
+  dconf_engine_call_handle_free (handle);
+}
+
+gboolean
+dconf_engine_change_async (DConfEngine                *engine,
+                           DConfChangeset             *changeset,
+                           DConfEngineChangeCallback   callback,
+                           gpointer                    user_data,
+                           GError                    **error)
+{
+  OutstandingAsyncChange *oac;
+
+  g_debug ("change_async");
+
+  if (dconf_changeset_is_empty (changeset))
     {
-      DConfEngineSource *source = engine->sources[i];
+      (* callback) (engine, "", NULL, user_data);
+      return TRUE;
+    }
 
-      if (source->bus_type == bus_type && g_str_equal (source->object_path, path))
-        return TRUE;
+  if (!dconf_engine_changeset_changes_only_writable_keys (engine, changeset, error))
+    return FALSE;
+
+  dconf_changeset_seal (changeset);
+
+  oac = dconf_engine_call_handle_new (engine, dconf_engine_change_async_completed,
+                                      G_VARIANT_TYPE ("(s)"), sizeof (OutstandingAsyncChange));
+  oac->change = dconf_changeset_ref (changeset);
+  oac->callback = callback;
+  oac->user_data = user_data;
+
+  /* Unlike fast writes, these bypass the queue: the caller wants to
+   * know about the completion of this particular change, so it must be
+   * sent as a request of its own.
+   */
+  if (!dconf_engine_dbus_call_async_func (engine->sources[0]->bus_type,
+                                          engine->sources[0]->bus_name,
+                                          engine->sources[0]->object_path,
+                                          "ca.desrt.dconf.Writer", "Change",
+                                          dconf_engine_prepare_change (engine, changeset),
+                                          &oac->handle, error))
+    {
+      dconf_changeset_unref (oac->change);
+      dconf_engine_call_handle_free (&oac->handle);
+      return FALSE;
     }
 
-  return FALSE;
+  return TRUE;
 }
 
 void
@@ -1456,7 +2483,8 @@ dconf_engine_handle_dbus_signal (GBusType     type,
       const gchar *prefix;
       const gchar **changes;
       const gchar *tag;
-      GSList *engines;
+      GPtrArray *engines;
+      guint i;
 
       if (!g_variant_is_of_type (body, G_VARIANT_TYPE ("(sass)")))
         return;
@@ -1483,8 +2511,6 @@ dconf_engine_handle_dbus_signal (GBusType     type,
            *
            *  ('/a/', ['b', 'c/']) == ['/a/b', '/a/c/']
            */
-          gint i;
-
           for (i = 0; changes[i]; i++)
             if (!dconf_is_rel_path (changes[i], NULL))
               goto junk;
@@ -1493,13 +2519,11 @@ dconf_engine_handle_dbus_signal (GBusType     type,
         /* Not a key or a dir? */
         goto junk;
 
-      g_mutex_lock (&dconf_engine_global_lock);
-      engines = g_slist_copy_deep (dconf_engine_global_list, (GCopyFunc) dconf_engine_ref, NULL);
-      g_mutex_unlock (&dconf_engine_global_lock);
+      engines = dconf_engine_signal_index_lookup (type, object_path);
 
-      while (engines)
+      for (i = 0; engines && i < engines->len; i++)
         {
-          DConfEngine *engine = engines->data;
+          DConfEngine *engine = engines->pdata[i];
 
           /* It's possible that this incoming change notify is for a
            * change that we already announced to the client when we
@@ -1507,15 +2531,12 @@ dconf_engine_handle_dbus_signal (GBusType     type,
            *
            * Check last_handled to determine if we should ignore it.
            */
-          if (!engine->last_handled || !g_str_equal (engine->last_handled, tag))
-            if (dconf_engine_is_interested_in_signal (engine, type, sender, object_path))
-              dconf_engine_change_notify (engine, prefix, changes, tag, FALSE, NULL, engine->user_data);
-
-          engines = g_slist_delete_link (engines, engines);
-
-          dconf_engine_unref (engine);
+          if (!g_queue_find_custom (&engine->last_handled, tag, (GCompareFunc) strcmp))
+            dconf_engine_change_notify (engine, prefix, changes, tag, FALSE, NULL, engine->user_data);
         }
 
+      g_clear_pointer (&engines, g_ptr_array_unref);
+
 junk:
       g_free (changes);
     }
@@ -1524,7 +2545,8 @@ junk:
     {
       const gchar *empty_str_list[] = { "", NULL };
       const gchar *path;
-      GSList *engines;
+      GPtrArray *engines;
+      guint i;
 
       if (!g_variant_is_of_type (body, G_VARIANT_TYPE ("(s)")))
         return;
@@ -1535,21 +2557,16 @@ junk:
       if (!dconf_is_path (path, NULL))
         return;
 
-      g_mutex_lock (&dconf_engine_global_lock);
-      engines = g_slist_copy_deep (dconf_engine_global_list, (GCopyFunc) dconf_engine_ref, NULL);
-      g_mutex_unlock (&dconf_engine_global_lock);
+      engines = dconf_engine_signal_index_lookup (type, object_path);
 
-      while (engines)
+      for (i = 0; engines && i < engines->len; i++)
         {
-          DConfEngine *engine = engines->data;
-
-          if (dconf_engine_is_interested_in_signal (engine, type, sender, object_path))
-            dconf_engine_change_notify (engine, path, empty_str_list, "", TRUE, NULL, engine->user_data);
+          DConfEngine *engine = engines->pdata[i];
 
-          engines = g_slist_delete_link (engines, engines);
-
-          dconf_engine_unref (engine);
+          dconf_engine_change_notify (engine, path, empty_str_list, "", TRUE, NULL, engine->user_data);
         }
+
+      g_clear_pointer (&engines, g_ptr_array_unref);
     }
 }
 
@@ -1562,7 +2579,7 @@ dconf_engine_has_outstanding (DConfEngine *engine)
    * also empty, so we only really need to check one of them...
    */
   dconf_engine_lock_queue (engine);
-  has = engine->in_flight != NULL;
+  has = engine->in_flight.length != 0;
   dconf_engine_unlock_queue (engine);
 
   return has;
@@ -1573,7 +2590,7 @@ dconf_engine_sync (DConfEngine *engine)
 {
   g_debug ("sync");
   dconf_engine_lock_queue (engine);
-  while (engine->in_flight != NULL)
+  while (engine->in_flight.length != 0)
     g_cond_wait (&engine->queue_cond, &engine->queue_lock);
   dconf_engine_unlock_queue (engine);
 }
@@ -134,11 +134,24 @@ GVariant *              dconf_engine_read                               (DConfEn
                                                                          const GQueue            *read_through,
                                                                          const gchar             *key);
 
+G_GNUC_INTERNAL
+GVariant **             dconf_engine_read_many                          (DConfEngine             *engine,
+                                                                         DConfReadFlags           flags,
+                                                                         const GQueue            *read_through,
+                                                                         const gchar * const     *keys,
+                                                                         gint                     n_keys);
+
 G_GNUC_INTERNAL
 gchar **                dconf_engine_list                               (DConfEngine             *engine,
                                                                          const gchar             *dir,
                                                                          gint                    *length);
 
+/* Statistics for the read cache enabled by DCONF_READ_CACHE_SIZE */
+G_GNUC_INTERNAL
+void                    dconf_engine_get_read_cache_stats               (DConfEngine             *engine,
+                                                                         guint64                 *hits,
+                                                                         guint64                 *misses);
+
 /* "Fast" API: all calls return immediately and look like they succeeded (from a local viewpoint) */
 G_GNUC_INTERNAL
 void                    dconf_engine_watch_fast                         (DConfEngine             *engine,
@@ -173,6 +186,19 @@ gboolean                dconf_engine_has_outstanding                    (DConfEn
 G_GNUC_INTERNAL
 void                    dconf_engine_sync                               (DConfEngine             *engine);
 
-/* Asynchronous API: not implemented yet (and maybe never?) */
+/* Asynchronous API: the callback is invoked exactly once, possibly
+ * from another thread, unless FALSE is returned
+ */
+typedef void         (* DConfEngineChangeCallback)                      (DConfEngine             *engine,
+                                                                         const gchar             *tag,
+                                                                         const GError            *error,
+                                                                         gpointer                 user_data);
+
+G_GNUC_INTERNAL
+gboolean                dconf_engine_change_async                       (DConfEngine             *engine,
+                                                                         DConfChangeset          *changeset,
+                                                                         DConfEngineChangeCallback callback,
+                                                                         gpointer                 user_data,
+                                                                         GError                 **error);
 
 #endif /* __dconf_engine_h__ */
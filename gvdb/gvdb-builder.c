@@ -27,6 +27,18 @@
 #endif
 #include <string.h>
 
+/* Number of bloom filter bits to reserve per hash item.  With two bits
+ * set per item, 16 bits per item gives a false positive rate of about
+ * 1.4%.  Define to 0 to produce files with an empty bloom filter.
+ */
+#ifndef GVDB_BLOOM_BITS_PER_ITEM
+#define GVDB_BLOOM_BITS_PER_ITEM 16
+#endif
+
+/* The second bloom bit is taken from the top bits of the hash, which
+ * are not used for selecting the word.
+ */
+#define GVDB_BLOOM_SHIFT 27
 
 struct _GvdbItem
 {
@@ -35,7 +47,6 @@ struct _GvdbItem
   guint32_le assigned_index;
   GvdbItem *parent;
   GvdbItem *sibling;
-  GvdbItem *next;
 
   /* one of:
    * this:
@@ -126,9 +137,15 @@ void
 gvdb_item_set_value (GvdbItem *item,
                      GVariant *value)
 {
-  g_return_if_fail (!item->value && !item->table && !item->child);
+  g_return_if_fail (!item->table && !item->child);
 
-  item->value = g_variant_ref_sink (value);
+  /* Replacing the value of an existing item is allowed so that a table
+   * can be kept around and updated in place between writes.
+   */
+  g_variant_ref_sink (value);
+  if (item->value)
+    g_variant_unref (item->value);
+  item->value = value;
 }
 
 void
@@ -159,45 +176,107 @@ gvdb_item_set_parent (GvdbItem *item,
   *node = item;
 }
 
-typedef struct
+gboolean
+gvdb_hash_table_remove (GHashTable  *table,
+                        const gchar *key)
 {
-  GvdbItem **buckets;
-  gint n_buckets;
-} HashTable;
+  GvdbItem *item, *parent;
 
-static HashTable *
-hash_table_new (gint n_buckets)
-{
-  HashTable *table;
+  item = g_hash_table_lookup (table, key);
 
-  table = g_slice_new (HashTable);
-  table->buckets = g_new0 (GvdbItem *, n_buckets);
-  table->n_buckets = n_buckets;
+  if (item == NULL)
+    return FALSE;
 
-  return table;
+  g_return_val_if_fail (item->child == NULL, FALSE);
+
+  parent = item->parent;
+
+  if (parent != NULL)
+    {
+      GvdbItem **node;
+
+      for (node = &parent->child; *node != item; node = &(*node)->sibling)
+        g_assert (*node != NULL);
+
+      *node = item->sibling;
+    }
+
+  g_hash_table_remove (table, key);
+
+  /* Directory items only exist to hold their children.  Once the last
+   * child is gone, the directory goes as well.
+   */
+  if (parent != NULL && parent->child == NULL &&
+      parent->value == NULL && parent->table == NULL)
+    gvdb_hash_table_remove (table, parent->key);
+
+  return TRUE;
 }
 
 static void
-hash_table_free (HashTable *table)
+gvdb_hash_table_remove_children (GHashTable *table,
+                                 GvdbItem   *item)
+{
+  GvdbItem *child;
+
+  /* Detach the whole list first, so that removing the children doesn't
+   * try to remove @item as a now-empty directory.
+   */
+  child = item->child;
+  item->child = NULL;
+
+  while (child != NULL)
+    {
+      GvdbItem *sibling = child->sibling;
+
+      gvdb_hash_table_remove_children (table, child);
+      g_hash_table_remove (table, child->key);
+
+      child = sibling;
+    }
+}
+
+gboolean
+gvdb_hash_table_remove_tree (GHashTable  *table,
+                             const gchar *key)
 {
-  g_free (table->buckets);
+  GvdbItem *item;
+
+  item = g_hash_table_lookup (table, key);
+
+  if (item == NULL)
+    return FALSE;
 
-  g_slice_free (HashTable, table);
+  gvdb_hash_table_remove_children (table, item);
+
+  return gvdb_hash_table_remove (table, key);
 }
 
-static void
-hash_table_insert (gpointer key,
-                   gpointer value,
-                   gpointer data)
+static gint
+item_compare_bucket (gconstpointer a,
+                     gconstpointer b,
+                     gpointer      user_data)
+{
+  const GvdbItem *ia = *(const GvdbItem **) a;
+  const GvdbItem *ib = *(const GvdbItem **) b;
+  guint32 n_buckets = GPOINTER_TO_UINT (user_data);
+  guint32 bucket_a = ia->hash_value % n_buckets;
+  guint32 bucket_b = ib->hash_value % n_buckets;
+
+  if (bucket_a != bucket_b)
+    return bucket_a < bucket_b ? -1 : 1;
+
+  return strcmp (ia->key, ib->key);
+}
+
+static gint
+item_compare_key (gconstpointer a,
+                  gconstpointer b)
 {
-  guint32 hash_value, bucket;
-  HashTable *table = data;
-  GvdbItem *item = value;
-
-  hash_value = djb_hash (key);
-  bucket = hash_value % table->n_buckets;
-  item->next = table->buckets[bucket];
-  table->buckets[bucket] = item;
+  const GvdbItem *ia = *(const GvdbItem **) a;
+  const GvdbItem *ib = *(const GvdbItem **) b;
+
+  return strcmp (ia->key, ib->key);
 }
 
 static guint32_le
@@ -214,6 +293,7 @@ typedef struct
   GQueue *chunks;
   guint64 offset;
   gboolean byteswap;
+  gboolean inline_values;
 } FileBuilder;
 
 typedef struct
@@ -276,6 +356,45 @@ file_builder_add_value (FileBuilder         *fb,
   g_variant_unref (normal);
 }
 
+static gboolean
+file_builder_add_inline_value (FileBuilder           *fb,
+                               GVariant              *value,
+                               struct gvdb_hash_item *entry)
+{
+  const gchar *type_string;
+  gsize size;
+
+  if (!fb->inline_values)
+    return FALSE;
+
+  type_string = g_variant_get_type_string (value);
+  if (type_string[0] == '\0' || type_string[1] != '\0')
+    return FALSE;
+
+  size = gvdb_inline_type_size (type_string[0]);
+  if (size == 0)
+    return FALSE;
+
+  g_assert (size <= sizeof entry->value.direct);
+  g_assert (g_variant_get_size (value) == size);
+
+  if (type_string[0] == 'b')
+    entry->value.direct[0] = g_variant_get_boolean (value);
+  else if (fb->byteswap)
+    {
+      value = g_variant_byteswap (value);
+      g_variant_store (value, entry->value.direct);
+      g_variant_unref (value);
+    }
+  else
+    g_variant_store (value, entry->value.direct);
+
+  entry->type = 'i';
+  entry->unused = type_string[0];
+
+  return TRUE;
+}
+
 static void
 file_builder_add_string (FileBuilder *fb,
                          const gchar *string,
@@ -339,13 +458,105 @@ file_builder_allocate_for_hash (FileBuilder            *fb,
 #undef chunk
 
   memset (*bloom_filter, 0, n_bloom_words * sizeof (guint32_le));
+}
+
+static void
+file_builder_bloom_add (guint32_le *bloom_filter,
+                        gsize       n_bloom_words,
+                        guint       bloom_shift,
+                        guint32     hash_value)
+{
+  guint32 word;
+  guint32 mask;
+
+  if (n_bloom_words == 0)
+    return;
+
+  /* This must agree with gvdb_table_bloom_filter() in the reader */
+  word = (hash_value / 32) % n_bloom_words;
+  mask = 1 << (hash_value & 31);
+  mask |= 1 << ((hash_value >> bloom_shift) & 31);
+
+  mask |= guint32_from_le (bloom_filter[word]);
+  bloom_filter[word] = guint32_to_le (mask);
+}
+
+static void
+file_builder_add_item (FileBuilder           *fb,
+                       GvdbItem              *item,
+                       struct gvdb_hash_item *entries,
+                       GQueue                *tables)
+{
+  struct gvdb_hash_item *entry;
+  const gchar *basename;
+
+  entry = &entries[guint32_from_le (item->assigned_index)];
 
-  /* NOTE - the code to actually fill in the bloom filter here is missing.
-   * Patches welcome! 
-   *
-   * http://en.wikipedia.org/wiki/Bloom_filter
-   * http://0pointer.de/blog/projects/bloom.html
+  if (item->parent != NULL)
+    basename = item->key + strlen (item->parent->key);
+  else
+    basename = item->key;
+
+  file_builder_add_string (fb, basename,
+                           &entry->key_start,
+                           &entry->key_size);
+
+  if (item->value != NULL)
+    {
+      g_assert (item->child == NULL && item->table == NULL);
+
+      if (!file_builder_add_inline_value (fb, item->value, entry))
+        {
+          file_builder_add_value (fb, item->value, &entry->value.pointer);
+          entry->type = 'v';
+        }
+    }
+
+  if (item->table != NULL)
+    {
+      g_assert (item->child == NULL);
+
+      /* Nested tables go after all of the data of this table */
+      entry->type = 'H';
+      g_queue_push_tail (tables, item);
+    }
+}
+
+static void
+file_builder_add_dir (FileBuilder           *fb,
+                      GvdbItem              *dir,
+                      struct gvdb_hash_item *entries,
+                      GQueue                *tables)
+{
+  struct gvdb_hash_item *entry;
+  guint32 children = 0, i = 0;
+  guint32_le *offsets;
+  GvdbItem *child;
+
+  entry = &entries[guint32_from_le (dir->assigned_index)];
+
+  for (child = dir->child; child; child = child->sibling)
+    children++;
+
+  offsets = file_builder_allocate (fb, 4, 4 * children,
+                                   &entry->value.pointer);
+  entry->type = 'L';
+
+  for (child = dir->child; child; child = child->sibling)
+    offsets[i++] = child->assigned_index;
+
+  g_assert (children == i);
+
+  /* The names and values of the children immediately follow the list,
+   * so that listing a dir and reading its keys touches as few pages as
+   * possible.  Subdirs come after that, depth first.
    */
+  for (child = dir->child; child; child = child->sibling)
+    file_builder_add_item (fb, child, entries, tables);
+
+  for (child = dir->child; child; child = child->sibling)
+    if (child->child != NULL)
+      file_builder_add_dir (fb, child, entries, tables);
 }
 
 static void
@@ -354,91 +565,101 @@ file_builder_add_hash (FileBuilder         *fb,
                        struct gvdb_pointer *pointer)
 {
   guint32_le *buckets, *bloom_filter;
-  struct gvdb_hash_item *items;
-  HashTable *mytable;
-  GvdbItem *item;
+  struct gvdb_hash_item *entries;
+  GPtrArray *items, *roots;
+  GQueue tables = G_QUEUE_INIT;
+  GHashTableIter iter;
+  gpointer value;
+  gsize n_bloom_words;
+  guint32 n_buckets;
+  guint32 bucket;
   guint32 index;
-  gint bucket;
-
-  mytable = hash_table_new (g_hash_table_size (table));
-  g_hash_table_foreach (table, hash_table_insert, mytable);
-  index = 0;
-
-  for (bucket = 0; bucket < mytable->n_buckets; bucket++)
-    for (item = mytable->buckets[bucket]; item; item = item->next)
-      item->assigned_index = guint32_to_le (index++);
 
-  file_builder_allocate_for_hash (fb, mytable->n_buckets, index, 5, 0,
-                                  &bloom_filter, &buckets, &items, pointer);
+  n_buckets = g_hash_table_size (table);
 
-  index = 0;
-  for (bucket = 0; bucket < mytable->n_buckets; bucket++)
+  /* The layout depends only on the contents of the table, not on the
+   * order in which g_hash_table_foreach() happens to visit the items:
+   * they are numbered by bucket (as required by the format) and then by
+   * key.
+   */
+  items = g_ptr_array_sized_new (n_buckets);
+  g_hash_table_iter_init (&iter, table);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    g_ptr_array_add (items, value);
+  g_ptr_array_sort_with_data (items, item_compare_bucket,
+                              GUINT_TO_POINTER (n_buckets));
+
+  roots = g_ptr_array_new ();
+  for (index = 0; index < items->len; index++)
     {
-      buckets[bucket] = guint32_to_le (index);
-
-      for (item = mytable->buckets[bucket]; item; item = item->next)
-        {
-          struct gvdb_hash_item *entry = items++;
-          const gchar *basename;
+      GvdbItem *item = g_ptr_array_index (items, index);
 
-          g_assert (index == guint32_from_le (item->assigned_index));
-          entry->hash_value = guint32_to_le (item->hash_value);
-          entry->parent = item_to_index (item->parent);
-          entry->unused = 0;
+      item->assigned_index = guint32_to_le (index);
 
-          if (item->parent != NULL)
-            basename = item->key + strlen (item->parent->key);
-          else
-            basename = item->key;
+      if (item->parent == NULL)
+        g_ptr_array_add (roots, item);
+    }
+  g_ptr_array_sort (roots, item_compare_key);
 
-          file_builder_add_string (fb, basename,
-                                   &entry->key_start,
-                                   &entry->key_size);
+  n_bloom_words = ((gsize) items->len * GVDB_BLOOM_BITS_PER_ITEM + 31) / 32;
 
-          if (item->value != NULL)
-            {
-              g_assert (item->child == NULL && item->table == NULL);
+  file_builder_allocate_for_hash (fb, n_buckets, items->len,
+                                  GVDB_BLOOM_SHIFT, n_bloom_words,
+                                  &bloom_filter, &buckets, &entries, pointer);
 
-              file_builder_add_value (fb, item->value, &entry->value.pointer);
-              entry->type = 'v';
-            }
+  /* Items without a value, such as an empty "/", would otherwise leave
+   * uninitialised bytes in the file.
+   */
+  memset (entries, 0, items->len * sizeof (struct gvdb_hash_item));
 
-          if (item->child != NULL)
-            {
-              guint32 children = 0, i = 0;
-              guint32_le *offsets;
-              GvdbItem *child;
+  bucket = 0;
+  for (index = 0; index < items->len; index++)
+    {
+      GvdbItem *item = g_ptr_array_index (items, index);
+      struct gvdb_hash_item *entry = &entries[index];
 
-              g_assert (item->table == NULL);
+      while (bucket <= item->hash_value % n_buckets)
+        buckets[bucket++] = guint32_to_le (index);
 
-              for (child = item->child; child; child = child->sibling)
-                children++;
+      entry->hash_value = guint32_to_le (item->hash_value);
+      file_builder_bloom_add (bloom_filter, n_bloom_words,
+                              GVDB_BLOOM_SHIFT, item->hash_value);
+      entry->parent = item_to_index (item->parent);
+    }
+  while (bucket < n_buckets)
+    buckets[bucket++] = guint32_to_le (index);
 
-              offsets = file_builder_allocate (fb, 4, 4 * children,
-                                               &entry->value.pointer);
-              entry->type = 'L';
+  /* Lay out the names and values in tree order rather than in bucket
+   * order, keeping the contents of each dir together.
+   */
+  for (index = 0; index < roots->len; index++)
+    file_builder_add_item (fb, g_ptr_array_index (roots, index),
+                           entries, &tables);
 
-              for (child = item->child; child; child = child->sibling)
-                offsets[i++] = child->assigned_index;
+  for (index = 0; index < roots->len; index++)
+    {
+      GvdbItem *root = g_ptr_array_index (roots, index);
 
-              g_assert (children == i);
-            }
+      if (root->child != NULL)
+        file_builder_add_dir (fb, root, entries, &tables);
+    }
 
-          if (item->table != NULL)
-            {
-              entry->type = 'H';
-              file_builder_add_hash (fb, item->table, &entry->value.pointer);
-            }
+  while (!g_queue_is_empty (&tables))
+    {
+      GvdbItem *item = g_queue_pop_head (&tables);
+      struct gvdb_hash_item *entry;
 
-          index++;
-        }
+      entry = &entries[guint32_from_le (item->assigned_index)];
+      file_builder_add_hash (fb, item->table, &entry->value.pointer);
     }
 
-  hash_table_free (mytable);
+  g_ptr_array_unref (roots);
+  g_ptr_array_unref (items);
 }
 
 static FileBuilder *
-file_builder_new (gboolean byteswap)
+file_builder_new (gboolean       byteswap,
+                  GvdbWriteFlags flags)
 {
   FileBuilder *builder;
 
@@ -446,6 +667,7 @@ file_builder_new (gboolean byteswap)
   builder->chunks = g_queue_new ();
   builder->offset = sizeof (struct gvdb_header);
   builder->byteswap = byteswap;
+  builder->inline_values = (flags & GVDB_WRITE_FLAGS_INLINE_VALUES) != 0;
 
   return builder;
 }
@@ -505,13 +727,29 @@ gvdb_table_write_contents (GHashTable   *table,
                            const gchar  *filename,
                            gboolean      byteswap,
                            GError      **error)
+{
+  return gvdb_table_write_contents_with_flags (table, filename, byteswap,
+                                               GVDB_WRITE_FLAGS_NONE, error);
+}
+
+/* GVDB_WRITE_FLAGS_INLINE_VALUES stores values of fixed-size basic
+ * types inline in their hash item ('i' items).  Readers that predate
+ * this do not know about 'i' items and will not find such values, so
+ * only pass it for files that are never read by an older reader.
+ */
+gboolean
+gvdb_table_write_contents_with_flags (GHashTable      *table,
+                                      const gchar     *filename,
+                                      gboolean         byteswap,
+                                      GvdbWriteFlags   flags,
+                                      GError         **error)
 {
   struct gvdb_pointer root;
   gboolean status;
   FileBuilder *fb;
   GString *str;
 
-  fb = file_builder_new (byteswap);
+  fb = file_builder_new (byteswap, flags);
   file_builder_add_hash (fb, table, &root);
   str = file_builder_serialise (fb, root);
 
@@ -24,6 +24,12 @@
 
 typedef struct _GvdbItem GvdbItem;
 
+typedef enum
+{
+  GVDB_WRITE_FLAGS_NONE          = 0,
+  GVDB_WRITE_FLAGS_INLINE_VALUES = (1 << 0)
+} GvdbWriteFlags;
+
 G_GNUC_INTERNAL
 GHashTable *            gvdb_hash_table_new                             (GHashTable    *parent,
                                                                          const gchar   *key);
@@ -32,6 +38,12 @@ G_GNUC_INTERNAL
 GvdbItem *              gvdb_hash_table_insert                          (GHashTable    *table,
                                                                          const gchar   *key);
 G_GNUC_INTERNAL
+gboolean                gvdb_hash_table_remove                          (GHashTable    *table,
+                                                                         const gchar   *key);
+G_GNUC_INTERNAL
+gboolean                gvdb_hash_table_remove_tree                     (GHashTable    *table,
+                                                                         const gchar   *key);
+G_GNUC_INTERNAL
 void                    gvdb_hash_table_insert_string                   (GHashTable    *table,
                                                                          const gchar   *key,
                                                                          const gchar   *value);
@@ -51,5 +63,11 @@ gboolean                gvdb_table_write_contents                       (GHashTa
                                                                          const gchar    *filename,
                                                                          gboolean        byteswap,
                                                                          GError        **error);
+G_GNUC_INTERNAL
+gboolean                gvdb_table_write_contents_with_flags            (GHashTable     *table,
+                                                                         const gchar    *filename,
+                                                                         gboolean        byteswap,
+                                                                         GvdbWriteFlags  flags,
+                                                                         GError        **error);
 
 #endif /* __gvdb_builder_h__ */
@@ -35,6 +35,15 @@ struct gvdb_hash_header {
   guint32_le n_buckets;
 };
 
+/* Item types:
+ *
+ *   'v': a value, stored as a serialised variant at value.pointer
+ *   'i': a value of a fixed-size basic type, stored inline: the type
+ *        string (a single character) is in 'unused' and the serialised
+ *        data is at the start of value.direct
+ *   'L': a dir, value.pointer refers to the list of its children
+ *   'H': a nested hash table at value.pointer
+ */
 struct gvdb_hash_item {
   guint32_le hash_value;
   guint32_le parent;
@@ -77,6 +86,25 @@ static inline guint16 guint16_from_le (guint16_le value) {
   return GUINT16_FROM_LE (value.value);
 }
 
+/* Returns the serialised size of values of the basic type @type_char
+ * that can be stored inline in an 'i' item, or 0 otherwise.
+ */
+static inline gsize gvdb_inline_type_size (gchar type_char) {
+  switch (type_char)
+    {
+    case 'b': case 'y':
+      return 1;
+    case 'n': case 'q':
+      return 2;
+    case 'i': case 'u':
+      return 4;
+    case 'x': case 't': case 'd':
+      return 8;
+    default:
+      return 0;
+    }
+}
+
 #define GVDB_SIGNATURE0 1918981703
 #define GVDB_SIGNATURE1 1953390953
 #define GVDB_SWAPPED_SIGNATURE0 GUINT32_SWAP_LE_BE (GVDB_SIGNATURE0)
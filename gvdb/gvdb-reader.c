@@ -96,6 +96,7 @@ gvdb_table_setup_root (GvdbTable                 *file,
 
   n_bloom_words = guint32_from_le (header->n_bloom_words);
   n_buckets = guint32_from_le (header->n_buckets);
+  file->bloom_shift = n_bloom_words >> 27;
   n_bloom_words &= (1u << 27) - 1;
 
   if G_UNLIKELY (n_bloom_words * sizeof (guint32_le) > size)
@@ -269,13 +270,42 @@ gvdb_table_check_name (GvdbTable             *file,
   return FALSE;
 }
 
-static const struct gvdb_hash_item *
-gvdb_table_lookup (GvdbTable   *file,
-                   const gchar *key,
-                   gchar        type)
+/**
+ * gvdb_table_hash_key:
+ * @key: a string
+ * @key_length: (out): the length of @key
+ *
+ * Computes the hash value of @key, as used by the gvdb file format, and
+ * its length.
+ *
+ * The result can be passed to gvdb_table_get_value_hashed() or
+ * gvdb_table_has_value_hashed() to look up the same key in any number
+ * of tables without hashing it each time.
+ *
+ * Returns: the hash value of @key
+ **/
+guint32
+gvdb_table_hash_key (const gchar *key,
+                     guint       *key_length)
 {
   guint32 hash_value = 5381;
-  guint key_length;
+  guint length;
+
+  for (length = 0; key[length]; length++)
+    hash_value = (hash_value * 33) + ((signed char *) key)[length];
+
+  *key_length = length;
+
+  return hash_value;
+}
+
+static const struct gvdb_hash_item *
+gvdb_table_lookup_hashed (GvdbTable   *file,
+                          const gchar *key,
+                          guint        key_length,
+                          guint32      hash_value,
+                          gchar        type)
+{
   guint32 bucket;
   guint32 lastno;
   guint32 itemno;
@@ -283,9 +313,6 @@ gvdb_table_lookup (GvdbTable   *file,
   if G_UNLIKELY (file->n_buckets == 0 || file->n_hash_items == 0)
     return NULL;
 
-  for (key_length = 0; key[key_length]; key_length++)
-    hash_value = (hash_value * 33) + ((signed char *) key)[key_length];
-
   if (!gvdb_table_bloom_filter (file, hash_value))
     return NULL;
 
@@ -302,7 +329,7 @@ gvdb_table_lookup (GvdbTable   *file,
 
       if (hash_value == guint32_from_le (item->hash_value))
         if G_LIKELY (gvdb_table_check_name (file, item, key, key_length))
-          if G_LIKELY (item->type == type)
+          if G_LIKELY (item->type == type || (type == 'v' && item->type == 'i'))
             return item;
 
       itemno++;
@@ -311,6 +338,19 @@ gvdb_table_lookup (GvdbTable   *file,
   return NULL;
 }
 
+static const struct gvdb_hash_item *
+gvdb_table_lookup (GvdbTable   *file,
+                   const gchar *key,
+                   gchar        type)
+{
+  guint32 hash_value;
+  guint key_length;
+
+  hash_value = gvdb_table_hash_key (key, &key_length);
+
+  return gvdb_table_lookup_hashed (file, key, key_length, hash_value, type);
+}
+
 static gboolean
 gvdb_table_list_from_item (GvdbTable                    *table,
                            const struct gvdb_hash_item  *item,
@@ -329,157 +369,193 @@ gvdb_table_list_from_item (GvdbTable                    *table,
   return TRUE;
 }
 
+/* Sentinel values for the offsets array in gvdb_table_foreach_name() */
+#define GVDB_NAME_UNKNOWN  G_MAXSIZE
+#define GVDB_NAME_INVALID  (G_MAXSIZE - 1)
+#define GVDB_NAME_PENDING  (G_MAXSIZE - 2)
+
 /**
- * gvdb_table_get_names:
+ * gvdb_table_foreach_name:
  * @table: a #GvdbTable
- * @length: (optional): the number of items returned, or %NULL
- *
- * Gets a list of all names contained in @table.
- *
- * No call to gvdb_table_get_table(), gvdb_table_list() or
- * gvdb_table_get_value() will succeed unless it is for one of the
- * names returned by this function.
+ * @func: the function to call for each name
+ * @user_data: user data for @func
  *
- * Note that some names that are returned may still fail for all of the
- * above calls in the case of the corrupted file.  Note also that the
- * returned strings may not be utf8.
+ * Calls @func for each name contained in @table, in the order that the
+ * items appear in the table.  The names are the same as those returned
+ * by gvdb_table_get_names().
  *
- * Returns: (array length=length): a %NULL-terminated list of strings, of length @length
+ * The name passed to @func is nul-terminated but it is only valid for
+ * the duration of the call.  No memory is allocated for each name.
  **/
-gchar **
-gvdb_table_get_names (GvdbTable *table,
-                      gsize     *length)
+void
+gvdb_table_foreach_name (GvdbTable         *table,
+                         GvdbTableNameFunc  func,
+                         gpointer           user_data)
 {
-  gchar **names;
-  gint n_names;
-  gint filled;
-  gint total;
-  gint i;
-
-  /* We generally proceed by iterating over the list of items in the
-   * hash table (in order of appearance) recording them into an array.
-   *
-   * Each item has a parent item (except root items).  The parent item
-   * forms part of the name of the item.  We could go fetching the
-   * parent item chain at the point that we encounter each item but then
-   * we would need to implement some sort of recursion along with checks
-   * for self-referential items.
-   *
-   * Instead, we do a number of passes.  Each pass will build up one
-   * level of names (starting from the root).  We continue to do passes
-   * until no more items are left.  The first pass will only add root
-   * items and each further pass will only add items whose direct parent
-   * is an item added in the immediately previous pass.  It's also
-   * possible that items get filled if they follow their parent within a
-   * particular pass.
+  gsize arena_size, arena_alloc;
+  guint32 n_items;
+  guint32 *stack;
+  gsize *offsets;
+  gsize *lengths;
+  gchar *arena;
+  guint32 i;
+
+  /* Each item has a parent item (except root items).  The parent item
+   * forms part of the name of the item.
    *
-   * At most we will have a number of passes equal to the depth of the
-   * tree.  Self-referential items will never be filled in (since their
-   * parent will have never been filled in).  We continue until we have
-   * a pass that fills in no additional items.
+   * We build all of the names into a single arena, remembering the
+   * offset and length of each one.  To find the name of an item we walk
+   * up the chain of parents until we find one whose name we already
+   * know (or a root item) and then fill in the names on the way back
+   * down.  Each item is therefore visited only a constant number of
+   * times, regardless of the depth of the tree.
    *
-   * This takes an O(n) algorithm and turns it into O(n*m) where m is
-   * the depth of the tree, but in all sane cases the tree won't be very
-   * deep and the constant factor of this algorithm is lower (and the
-   * complexity of coding it, as well).
+   * Items that are on the current chain are marked as pending.  If we
+   * find a pending item as the parent of another one then the file is
+   * corrupt and contains a cycle.  Those items (and anything below them)
+   * are marked as invalid and skipped, as are items with bad keys or
+   * out-of-range parents.
    */
 
-  n_names = table->n_hash_items;
-  names = g_new0 (gchar *, n_names + 1);
+  n_items = table->n_hash_items;
 
-  /* 'names' starts out all-NULL.  On each pass we record the number
-   * of items changed from NULL to non-NULL in 'filled' so we know if we
-   * should repeat the loop.  'total' counts the total number of items
-   * filled.  If 'total' ends up equal to 'n_names' then we know that
-   * 'names' has been completely filled.
-   */
+  if (n_items == 0)
+    return;
+
+  offsets = g_new (gsize, n_items);
+  lengths = g_new (gsize, n_items);
+  stack = g_new (guint32, n_items);
 
-  total = 0;
-  do
+  for (i = 0; i < n_items; i++)
+    offsets[i] = GVDB_NAME_UNKNOWN;
+
+  arena_alloc = 256;
+  arena = g_malloc (arena_alloc);
+  arena_size = 0;
+
+  for (i = 0; i < n_items; i++)
     {
-      /* Loop until we have filled no more entries */
-      filled = 0;
+      guint32 depth = 0;
+      guint32 j = i;
 
-      for (i = 0; i < n_names; i++)
+      while (j < n_items && offsets[j] == GVDB_NAME_UNKNOWN)
         {
-          const struct gvdb_hash_item *item = &table->hash_items[i];
+          offsets[j] = GVDB_NAME_PENDING;
+          stack[depth++] = j;
+          j = guint32_from_le (table->hash_items[j].parent);
+        }
+
+      while (depth > 0)
+        {
+          const struct gvdb_hash_item *item;
+          gsize parent_offset, parent_length;
           const gchar *name;
           gsize name_length;
           guint32 parent;
+          gsize needed;
 
-          /* already got it on a previous pass */
-          if (names[i] != NULL)
-            continue;
-
+          j = stack[--depth];
+          item = &table->hash_items[j];
           parent = guint32_from_le (item->parent);
+          name = gvdb_table_item_get_key (table, item, &name_length);
+
+          if (name == NULL)
+            {
+              offsets[j] = GVDB_NAME_INVALID;
+              continue;
+            }
 
           if (parent == 0xffffffffu)
             {
               /* it's a root item */
-              name = gvdb_table_item_get_key (table, item, &name_length);
-
-              if (name != NULL)
-                {
-                  names[i] = g_strndup (name, name_length);
-                  filled++;
-                }
+              parent_offset = 0;
+              parent_length = 0;
+            }
+          else if (parent < n_items && offsets[parent] < GVDB_NAME_PENDING)
+            {
+              parent_offset = offsets[parent];
+              parent_length = lengths[parent];
+            }
+          else
+            {
+              offsets[j] = GVDB_NAME_INVALID;
+              continue;
             }
 
-          else if (parent < n_names && names[parent] != NULL)
+          needed = arena_size + parent_length + name_length + 1;
+          if (needed > arena_alloc)
             {
-              /* It's a non-root item whose parent was filled in already.
-               *
-               * Calculate the name of this item by combining it with
-               * its parent name.
-               */
-              name = gvdb_table_item_get_key (table, item, &name_length);
-
-              if (name != NULL)
-                {
-                  const gchar *parent_name = names[parent];
-                  gsize parent_length;
-                  gchar *fullname;
-
-                  parent_length = strlen (parent_name);
-                  fullname = g_malloc (parent_length + name_length + 1);
-                  memcpy (fullname, parent_name, parent_length);
-                  memcpy (fullname + parent_length, name, name_length);
-                  fullname[parent_length + name_length] = '\0';
-                  names[i] = fullname;
-                  filled++;
-                }
+              while (needed > arena_alloc)
+                arena_alloc *= 2;
+              arena = g_realloc (arena, arena_alloc);
             }
-        }
 
-      total += filled;
+          memcpy (arena + arena_size, arena + parent_offset, parent_length);
+          memcpy (arena + arena_size + parent_length, name, name_length);
+          arena[needed - 1] = '\0';
+
+          offsets[j] = arena_size;
+          lengths[j] = parent_length + name_length;
+          arena_size = needed;
+        }
     }
-  while (filled && total < n_names);
 
-  /* If the table was corrupted then 'names' may have holes in it.
-   * Collapse those.
-   */
-  if G_UNLIKELY (total != n_names)
-    {
-      GPtrArray *fixed_names;
+  for (i = 0; i < n_items; i++)
+    if (offsets[i] < GVDB_NAME_PENDING)
+      (* func) (arena + offsets[i], lengths[i], user_data);
 
-      fixed_names = g_ptr_array_sized_new (n_names);
-      for (i = 0; i < n_names; i++)
-        if (names[i] != NULL)
-          g_ptr_array_add (fixed_names, names[i]);
+  g_free (arena);
+  g_free (stack);
+  g_free (lengths);
+  g_free (offsets);
+}
 
-      g_free (names);
-      n_names = fixed_names->len;
-      g_ptr_array_add (fixed_names, NULL);
-      names = (gchar **) g_ptr_array_free (fixed_names, FALSE);
-    }
+static void
+gvdb_table_collect_name (const gchar *name,
+                         gsize        length,
+                         gpointer     user_data)
+{
+  g_ptr_array_add (user_data, g_strndup (name, length));
+}
+
+/**
+ * gvdb_table_get_names:
+ * @table: a #GvdbTable
+ * @length: (optional): the number of items returned, or %NULL
+ *
+ * Gets a list of all names contained in @table.
+ *
+ * No call to gvdb_table_get_table(), gvdb_table_list() or
+ * gvdb_table_get_value() will succeed unless it is for one of the
+ * names returned by this function.
+ *
+ * Note that some names that are returned may still fail for all of the
+ * above calls in the case of the corrupted file.  Note also that the
+ * returned strings may not be utf8.
+ *
+ * If you only need to look at each name once, gvdb_table_foreach_name()
+ * avoids allocating a copy of each of them.
+ *
+ * Returns: (array length=length): a %NULL-terminated list of strings, of length @length
+ **/
+gchar **
+gvdb_table_get_names (GvdbTable *table,
+                      gsize     *length)
+{
+  GPtrArray *names;
+
+  names = g_ptr_array_sized_new (table->n_hash_items + 1);
+  gvdb_table_foreach_name (table, gvdb_table_collect_name, names);
 
   if (length)
     {
-      G_STATIC_ASSERT (sizeof (*length) >= sizeof (n_names));
-      *length = n_names;
+      G_STATIC_ASSERT (sizeof (*length) >= sizeof (names->len));
+      *length = names->len;
     }
 
-  return names;
+  g_ptr_array_add (names, NULL);
+
+  return (gchar **) g_ptr_array_free (names, FALSE);
 }
 
 /**
@@ -562,17 +638,98 @@ gboolean
 gvdb_table_has_value (GvdbTable    *file,
                       const gchar  *key)
 {
-  static const struct gvdb_hash_item *item;
+  guint32 hash_value;
+  guint key_length;
+
+  hash_value = gvdb_table_hash_key (key, &key_length);
+
+  return gvdb_table_has_value_hashed (file, key, key_length, hash_value);
+}
+
+/**
+ * gvdb_table_has_value_hashed:
+ * @file: a #GvdbTable
+ * @key: a string
+ * @key_length: the length of @key
+ * @hash_value: the hash of @key, from gvdb_table_hash_key()
+ *
+ * Equivalent to gvdb_table_has_value(), but using a precomputed hash.
+ *
+ * Returns: %TRUE if @key is in the table
+ **/
+gboolean
+gvdb_table_has_value_hashed (GvdbTable   *file,
+                             const gchar *key,
+                             guint        key_length,
+                             guint32      hash_value)
+{
+  const struct gvdb_hash_item *item;
   gsize size;
 
-  item = gvdb_table_lookup (file, key, 'v');
+  item = gvdb_table_lookup_hashed (file, key, key_length, hash_value, 'v');
 
   if (item == NULL)
     return FALSE;
 
+  if (item->type == 'i')
+    return gvdb_inline_type_size (item->unused) != 0;
+
   return gvdb_table_dereference (file, &item->value.pointer, 8, &size) != NULL;
 }
 
+static GVariant *
+gvdb_table_value_from_inline_item (const struct gvdb_hash_item *item)
+{
+  const gchar *data = item->value.direct;
+  GVariant *value;
+  union {
+    guint16 u16;
+    guint32 u32;
+    guint64 u64;
+    gdouble dbl;
+  } v;
+
+  /* The data is copied as is, in file byte order, just like the
+   * contents of a 'v' item is used without swapping.
+   */
+  memcpy (&v, data, gvdb_inline_type_size (item->unused));
+
+  switch (item->unused)
+    {
+    case 'b':
+      value = g_variant_new_boolean (data[0] != 0);
+      break;
+    case 'y':
+      value = g_variant_new_byte (data[0]);
+      break;
+    case 'n':
+      value = g_variant_new_int16 (v.u16);
+      break;
+    case 'q':
+      value = g_variant_new_uint16 (v.u16);
+      break;
+    case 'i':
+      value = g_variant_new_int32 (v.u32);
+      break;
+    case 'u':
+      value = g_variant_new_uint32 (v.u32);
+      break;
+    case 'x':
+      value = g_variant_new_int64 (v.u64);
+      break;
+    case 't':
+      value = g_variant_new_uint64 (v.u64);
+      break;
+    case 'd':
+      value = g_variant_new_double (v.dbl);
+      break;
+    default:
+      return NULL;
+    }
+
+  return g_variant_ref_sink (value);
+}
+
 static GVariant *
 gvdb_table_value_from_item (GvdbTable                   *table,
                             const struct gvdb_hash_item *item)
@@ -582,6 +739,9 @@ gvdb_table_value_from_item (GvdbTable                   *table,
   GBytes *bytes;
   gsize size;
 
+  if (item->type == 'i')
+    return gvdb_table_value_from_inline_item (item);
+
   data = gvdb_table_dereference (table, &item->value.pointer, 8, &size);
 
   if G_UNLIKELY (data == NULL)
@@ -615,11 +775,36 @@ gvdb_table_value_from_item (GvdbTable                   *table,
 GVariant *
 gvdb_table_get_value (GvdbTable    *file,
                       const gchar  *key)
+{
+  guint32 hash_value;
+  guint key_length;
+
+  hash_value = gvdb_table_hash_key (key, &key_length);
+
+  return gvdb_table_get_value_hashed (file, key, key_length, hash_value);
+}
+
+/**
+ * gvdb_table_get_value_hashed:
+ * @file: a #GvdbTable
+ * @key: a string
+ * @key_length: the length of @key
+ * @hash_value: the hash of @key, from gvdb_table_hash_key()
+ *
+ * Equivalent to gvdb_table_get_value(), but using a precomputed hash.
+ *
+ * Returns: a #GVariant, or %NULL
+ **/
+GVariant *
+gvdb_table_get_value_hashed (GvdbTable   *file,
+                             const gchar *key,
+                             guint        key_length,
+                             guint32      hash_value)
 {
   const struct gvdb_hash_item *item;
   GVariant *value;
 
-  if ((item = gvdb_table_lookup (file, key, 'v')) == NULL)
+  if ((item = gvdb_table_lookup_hashed (file, key, key_length, hash_value, 'v')) == NULL)
     return NULL;
 
   value = gvdb_table_value_from_item (file, item);
@@ -636,6 +821,165 @@ gvdb_table_get_value (GvdbTable    *file,
   return value;
 }
 
+/**
+ * gvdb_table_peek_value:
+ * @table: a #GvdbTable
+ * @key: a string
+ * @type: (out): the type of the value
+ * @data: (out): the serialised data of the value, or %NULL
+ * @size: (out): the size of @data
+ * @scratch: (nullable): a buffer to byteswap small values into
+ * @scratch_size: the size of @scratch
+ *
+ * Looks up a value named @key in @table without allocating any memory.
+ *
+ * On success, @type and @data point directly into the table and remain
+ * valid for as long as @table does.  @data is the serialised form of the
+ * value, suitable for g_variant_new_from_data() or for comparing with
+ * g_variant_get_data() of a value in normal form.  If @table was opened
+ * as untrusted then the data may not be in normal form.
+ *
+ * If @table is byteswapped, values whose serialised form does not depend
+ * on the byte order (such as booleans, strings and arrays of them) are
+ * still returned directly.  Values of the fixed-size numeric types are
+ * byteswapped into @scratch if it is at least 8 bytes long, and @data
+ * then points to @scratch.  For all other values @data is set to %NULL;
+ * use gvdb_table_get_value() to read those.
+ *
+ * Returns: %TRUE if @key is in the table
+ **/
+gboolean
+gvdb_table_peek_value (GvdbTable           *table,
+                       const gchar         *key,
+                       const GVariantType **type,
+                       gconstpointer       *data,
+                       gsize               *size,
+                       gpointer             scratch,
+                       gsize                scratch_size)
+{
+  guint32 hash_value;
+  guint key_length;
+
+  hash_value = gvdb_table_hash_key (key, &key_length);
+
+  return gvdb_table_peek_value_hashed (table, key, key_length, hash_value,
+                                       type, data, size, scratch, scratch_size);
+}
+
+/* Whether the serialised form of values of the given type is the same in
+ * both byte orders.  Framing offsets are always little endian, so only
+ * the numeric basic types (and variants, which may contain anything)
+ * are affected by byteswapping.
+ */
+static gboolean
+gvdb_type_is_byte_order_independent (const gchar *type_string,
+                                     const gchar *end)
+{
+  while (type_string < end)
+    if (strchr ("nqiuxtdhv", *type_string++) != NULL)
+      return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * gvdb_table_peek_value_hashed:
+ * @table: a #GvdbTable
+ * @key: a string
+ * @key_length: the length of @key
+ * @hash_value: the hash of @key, from gvdb_table_hash_key()
+ * @type: (out): the type of the value
+ * @data: (out): the serialised data of the value, or %NULL
+ * @size: (out): the size of @data
+ * @scratch: (nullable): a buffer to byteswap small values into
+ * @scratch_size: the size of @scratch
+ *
+ * Equivalent to gvdb_table_peek_value(), but using a precomputed hash.
+ *
+ * Returns: %TRUE if @key is in the table
+ **/
+gboolean
+gvdb_table_peek_value_hashed (GvdbTable           *table,
+                              const gchar         *key,
+                              guint                key_length,
+                              guint32              hash_value,
+                              const GVariantType **type,
+                              gconstpointer       *data,
+                              gsize               *size,
+                              gpointer             scratch,
+                              gsize                scratch_size)
+{
+  const struct gvdb_hash_item *item;
+  const gchar *type_string, *type_end;
+  const gchar *start;
+  gsize value_size;
+
+  item = gvdb_table_lookup_hashed (table, key, key_length, hash_value, 'v');
+
+  if (item == NULL)
+    return FALSE;
+
+  if (item->type == 'i')
+    {
+      value_size = gvdb_inline_type_size (item->unused);
+      if G_UNLIKELY (value_size == 0)
+        return FALSE;
+
+      start = item->value.direct;
+      type_string = &item->unused;
+      type_end = type_string + 1;
+    }
+  else
+    {
+      const gchar *nul;
+      gsize size;
+
+      start = gvdb_table_dereference (table, &item->value.pointer, 8, &size);
+      if G_UNLIKELY (start == NULL)
+        return FALSE;
+
+      /* A serialised variant is the data of the child, a nul byte and
+       * then the type string of the child.
+       */
+      type_end = start + size;
+      for (nul = type_end; nul > start && nul[-1] != '\0'; nul--)
+        ;
+
+      if G_UNLIKELY (nul == start)
+        return FALSE;
+
+      type_string = nul;
+      value_size = (nul - 1) - start;
+
+      if G_UNLIKELY (!g_variant_type_string_scan (type_string, type_end, &nul) || nul != type_end)
+        return FALSE;
+    }
+
+  if (table->byteswapped && !gvdb_type_is_byte_order_independent (type_string, type_end))
+    {
+      gsize n = (type_end - type_string == 1) ? gvdb_inline_type_size (type_string[0]) : 0;
+
+      if (n != 0 && n == value_size && scratch != NULL && scratch_size >= 8)
+        {
+          gchar *swapped = scratch;
+          gsize i;
+
+          for (i = 0; i < n; i++)
+            swapped[i] = start[n - 1 - i];
+
+          start = scratch;
+        }
+      else
+        start = NULL;
+    }
+
+  *type = (const GVariantType *) type_string;
+  *data = start;
+  *size = value_size;
+
+  return TRUE;
+}
+
 /**
  * gvdb_table_get_raw_value:
  * @table: a #GvdbTable
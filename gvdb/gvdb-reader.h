@@ -39,6 +39,10 @@
 
 typedef struct _GvdbTable GvdbTable;
 
+typedef void (* GvdbTableNameFunc) (const gchar *name,
+                                    gsize        length,
+                                    gpointer     user_data);
+
 G_BEGIN_DECLS
 
 G_GNUC_INTERNAL GVDB_GNUC_WEAK
@@ -55,6 +59,10 @@ G_GNUC_INTERNAL GVDB_GNUC_WEAK
 gchar **                gvdb_table_get_names                            (GvdbTable    *table,
                                                                          gsize        *length);
 G_GNUC_INTERNAL GVDB_GNUC_WEAK
+void                    gvdb_table_foreach_name                         (GvdbTable         *table,
+                                                                         GvdbTableNameFunc  func,
+                                                                         gpointer           user_data);
+G_GNUC_INTERNAL GVDB_GNUC_WEAK
 gchar **                gvdb_table_list                                 (GvdbTable    *table,
                                                                          const gchar  *key);
 G_GNUC_INTERNAL GVDB_GNUC_WEAK
@@ -71,6 +79,37 @@ G_GNUC_INTERNAL GVDB_GNUC_WEAK
 gboolean                gvdb_table_has_value                            (GvdbTable    *table,
                                                                          const gchar  *key);
 G_GNUC_INTERNAL GVDB_GNUC_WEAK
+guint32                 gvdb_table_hash_key                             (const gchar  *key,
+                                                                         guint        *key_length);
+G_GNUC_INTERNAL GVDB_GNUC_WEAK
+GVariant *              gvdb_table_get_value_hashed                     (GvdbTable    *table,
+                                                                         const gchar  *key,
+                                                                         guint         key_length,
+                                                                         guint32       hash_value);
+G_GNUC_INTERNAL GVDB_GNUC_WEAK
+gboolean                gvdb_table_has_value_hashed                     (GvdbTable    *table,
+                                                                         const gchar  *key,
+                                                                         guint         key_length,
+                                                                         guint32       hash_value);
+G_GNUC_INTERNAL GVDB_GNUC_WEAK
+gboolean                gvdb_table_peek_value                           (GvdbTable            *table,
+                                                                         const gchar          *key,
+                                                                         const GVariantType  **type,
+                                                                         gconstpointer        *data,
+                                                                         gsize                *size,
+                                                                         gpointer              scratch,
+                                                                         gsize                 scratch_size);
+G_GNUC_INTERNAL GVDB_GNUC_WEAK
+gboolean                gvdb_table_peek_value_hashed                    (GvdbTable            *table,
+                                                                         const gchar          *key,
+                                                                         guint                 key_length,
+                                                                         guint32               hash_value,
+                                                                         const GVariantType  **type,
+                                                                         gconstpointer        *data,
+                                                                         gsize                *size,
+                                                                         gpointer              scratch,
+                                                                         gsize                 scratch_size);
+G_GNUC_INTERNAL GVDB_GNUC_WEAK
 gboolean                gvdb_table_is_valid                             (GvdbTable    *table);
 
 G_END_DECLS
@@ -301,6 +301,24 @@ dconf_service_startup (GApplication *application)
 static void
 dconf_service_shutdown (GApplication *application)
 {
+  DConfService *service = DCONF_SERVICE (application);
+  GHashTableIter iter;
+  gpointer value;
+
+  /* Commit any coalesced changes and reply to their callers while we
+   * are still on the bus.
+   */
+  g_hash_table_iter_init (&iter, service->writers);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      GHashTableIter writers;
+      gpointer writer;
+
+      g_hash_table_iter_init (&writers, value);
+      while (g_hash_table_iter_next (&writers, NULL, &writer))
+        dconf_writer_flush_queue (writer);
+    }
+
   G_APPLICATION_CLASS (dconf_service_parent_class)
     ->shutdown (application);
 }
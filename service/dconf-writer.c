@@ -46,8 +46,23 @@ struct _DConfWriterPrivate
   DConfChangeset *uncommited_values;
   DConfChangeset *commited_values;
 
+  /* The gvdb builder table for the database, kept in sync with
+   * uncommited_values so that a commit doesn't need to rebuild it from
+   * scratch.  NULL until the first commit (or after a failed one).
+   */
+  GHashTable *gvdb;
+
   GQueue uncommited_changes;
   GQueue commited_changes;
+
+  /* Incoming changes waiting to be committed together.  The window is
+   * taken from DCONF_WRITE_COALESCE_MS: -1 (the default) disables
+   * coalescing, 0 waits until there is nothing else to dispatch and any
+   * other value is a timeout in milliseconds.
+   */
+  gint coalesce_ms;
+  GQueue queued_changes;
+  guint flush_id;
 };
 
 typedef struct
@@ -56,6 +71,13 @@ typedef struct
   gchar          *tag;
 } TaggedChange;
 
+typedef struct
+{
+  GDBusMethodInvocation *invocation;
+  DConfChangeset        *changeset;
+  gchar                 *tag;
+} QueuedChange;
+
 static void dconf_writer_iface_init (DConfDBusWriterIface *iface);
 
 G_DEFINE_TYPE_WITH_CODE (DConfWriter, dconf_writer, DCONF_DBUS_TYPE_WRITER_SKELETON,
@@ -136,6 +158,8 @@ dconf_writer_real_change (DConfWriter    *writer,
   if (effective_changeset)
     {
       dconf_changeset_change (writer->priv->uncommited_values, effective_changeset);
+      if (writer->priv->gvdb)
+        dconf_gvdb_utils_table_apply_changeset (writer->priv->gvdb, effective_changeset);
       if (tag)
         {
           TaggedChange *change;
@@ -171,7 +195,13 @@ dconf_writer_real_commit (DConfWriter  *writer,
     /* If it fails, it doesn't matter... */
     invalidate_fd = open (writer->priv->filename, O_WRONLY);
 
-  if (!dconf_gvdb_utils_write_file (writer->priv->filename, writer->priv->uncommited_values, error))
+  if (writer->priv->gvdb == NULL)
+    writer->priv->gvdb = dconf_gvdb_utils_table_from_changeset (writer->priv->uncommited_values);
+
+  /* Only building the table is incremental.  Writing it out still
+   * serialises every key, so a commit remains O(database size).
+   */
+  if (!dconf_gvdb_utils_write_table (writer->priv->filename, writer->priv->gvdb, error))
     return FALSE;
 
   if (writer->priv->native)
@@ -227,6 +257,13 @@ dconf_writer_real_end (DConfWriter *writer)
       g_slice_free (TaggedChange, change);
     }
 
+  /* If the changes were not committed then the builder table has
+   * diverged from commited_values.  Throw it away and rebuild it on the
+   * next commit.
+   */
+  if (writer->priv->uncommited_values)
+    g_clear_pointer (&writer->priv->gvdb, g_hash_table_unref);
+
   g_clear_pointer (&writer->priv->uncommited_values, dconf_changeset_unref);
 }
 
@@ -273,6 +310,101 @@ dconf_writer_complete_invocation (DConfDBusWriter       *dbus_writer,
     g_dbus_method_invocation_return_value (invocation, result);
 }
 
+static gboolean
+dconf_writer_flush (gpointer user_data)
+{
+  DConfWriter *writer = user_data;
+  GQueue queued = writer->priv->queued_changes;
+  GError *error = NULL;
+  gboolean any_changes = FALSE;
+  GList *node;
+
+  g_queue_init (&writer->priv->queued_changes);
+  writer->priv->flush_id = 0;
+
+  for (node = queued.head; node; node = node->next)
+    {
+      QueuedChange *queued_change = node->data;
+
+      if (dconf_changeset_describe (queued_change->changeset, NULL, NULL, NULL))
+        any_changes = TRUE;
+    }
+
+  /* One transaction for the whole batch.  Each change keeps its own tag
+   * so that dconf_writer_real_end() emits one Notify per caller.
+   */
+  if (any_changes && dconf_writer_begin (writer, &error))
+    {
+      for (node = queued.head; node; node = node->next)
+        {
+          QueuedChange *queued_change = node->data;
+
+          if (dconf_changeset_describe (queued_change->changeset, NULL, NULL, NULL))
+            dconf_writer_change (writer, queued_change->changeset, queued_change->tag);
+        }
+
+      dconf_writer_commit (writer, &error);
+    }
+
+  while (!g_queue_is_empty (&queued))
+    {
+      QueuedChange *queued_change = g_queue_pop_head (&queued);
+
+      if (error)
+        dconf_writer_complete_invocation (DCONF_DBUS_WRITER (writer), queued_change->invocation,
+                                          NULL, g_error_copy (error));
+      else
+        dconf_writer_complete_invocation (DCONF_DBUS_WRITER (writer), queued_change->invocation,
+                                          g_variant_new ("(s)", queued_change->tag), NULL);
+
+      dconf_changeset_unref (queued_change->changeset);
+      g_free (queued_change->tag);
+      g_slice_free (QueuedChange, queued_change);
+    }
+
+  g_clear_error (&error);
+
+  dconf_writer_end (writer);
+
+  return G_SOURCE_REMOVE;
+}
+
+void
+dconf_writer_flush_queue (DConfWriter *writer)
+{
+  if (writer->priv->flush_id)
+    {
+      g_source_remove (writer->priv->flush_id);
+      dconf_writer_flush (writer);
+    }
+}
+
+static void
+dconf_writer_queue_change (DConfWriter           *writer,
+                           GDBusMethodInvocation *invocation,
+                           DConfChangeset        *changeset,
+                           const gchar           *tag)
+{
+  QueuedChange *queued_change;
+
+  queued_change = g_slice_new (QueuedChange);
+  queued_change->invocation = invocation;
+  queued_change->changeset = dconf_changeset_ref (changeset);
+  queued_change->tag = g_strdup (tag);
+  g_queue_push_tail (&writer->priv->queued_changes, queued_change);
+
+  if (writer->priv->flush_id)
+    return;
+
+  if (writer->priv->coalesce_ms == 0)
+    writer->priv->flush_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, dconf_writer_flush,
+                                              g_object_ref (writer), g_object_unref);
+  else
+    writer->priv->flush_id = g_timeout_add_full (G_PRIORITY_DEFAULT, writer->priv->coalesce_ms,
+                                                 dconf_writer_flush,
+                                                 g_object_ref (writer), g_object_unref);
+}
+
 static gboolean
 dconf_writer_handle_init (DConfDBusWriter       *dbus_writer,
                           GDBusMethodInvocation *invocation)
@@ -282,6 +414,9 @@ dconf_writer_handle_init (DConfDBusWriter       *dbus_writer,
 
   dconf_blame_record (invocation);
 
+  /* Anything queued up was sent before this call */
+  dconf_writer_flush_queue (writer);
+
   if (dconf_writer_begin (writer, &error))
     dconf_writer_commit (writer, &error);
 
@@ -308,14 +443,33 @@ dconf_writer_handle_change (DConfDBusWriter       *dbus_writer,
                                  g_variant_get_data (blob), g_variant_get_size (blob), FALSE,
                                  (GDestroyNotify) g_variant_unref, g_variant_ref (blob));
   g_variant_ref_sink (tmp);
-  args = g_variant_get_normal_form (tmp);
-  g_variant_unref (tmp);
+
+  /* Clients normally send data in normal form, so only make a copy if
+   * they didn't.  Either way, the changeset refers to the data in args
+   * rather than copying it.
+   */
+  if (g_variant_is_normal_form (tmp))
+    args = tmp;
+  else
+    {
+      args = g_variant_get_normal_form (tmp);
+      g_variant_unref (tmp);
+    }
 
   changeset = dconf_changeset_deserialise (args);
   g_variant_unref (args);
 
   tag = dconf_writer_get_tag (writer);
 
+  if (writer->priv->coalesce_ms >= 0)
+    {
+      dconf_writer_queue_change (writer, invocation, changeset, tag);
+      dconf_changeset_unref (changeset);
+      g_free (tag);
+
+      return TRUE;
+    }
+
   /* Don't bother with empty changesets... */
   if (dconf_changeset_describe (changeset, NULL, NULL, NULL))
     {
@@ -351,9 +505,23 @@ dconf_writer_iface_init (DConfDBusWriterIface *iface)
 static void
 dconf_writer_init (DConfWriter *writer)
 {
+  const gchar *coalesce;
+
   writer->priv = dconf_writer_get_instance_private (writer);
   writer->priv->basepath = g_build_filename (g_get_user_config_dir (), "dconf", NULL);
   writer->priv->native = TRUE;
+  writer->priv->coalesce_ms = -1;
+
+  coalesce = g_getenv ("DCONF_WRITE_COALESCE_MS");
+  if (coalesce != NULL)
+    {
+      gint64 value;
+
+      if (g_ascii_string_to_signed (coalesce, 10, 0, G_MAXINT, &value, NULL))
+        writer->priv->coalesce_ms = value;
+      else
+        g_warning ("ignoring invalid DCONF_WRITE_COALESCE_MS value '%s'", coalesce);
+    }
 }
 
 static void
@@ -337,6 +337,75 @@ test_reset (void)
   dconf_changeset_unref (changeset);
 }
 
+static void
+test_reset_nested (void)
+{
+  DConfChangeset *database;
+  DConfChangeset *changeset;
+  DConfChangeset *filtered;
+  GVariant *value;
+
+  changeset = dconf_changeset_new ();
+  dconf_changeset_set (changeset, "/a/b/c", g_variant_new_int32 (1));
+  dconf_changeset_set (changeset, "/a/b/d/e", g_variant_new_int32 (2));
+  dconf_changeset_set (changeset, "/a/f", g_variant_new_int32 (3));
+  dconf_changeset_set (changeset, "/g", g_variant_new_int32 (4));
+
+  /* Resetting a subdir drops everything below it, but nothing else */
+  dconf_changeset_set (changeset, "/a/b/d/", NULL);
+  dconf_changeset_set (changeset, "/a/b/", NULL);
+  g_assert_true (dconf_changeset_get (changeset, "/a/b/c", &value));
+  g_assert_null (value);
+  g_assert_true (dconf_changeset_get (changeset, "/a/b/d/e", &value));
+  g_assert_null (value);
+  g_assert_true (dconf_changeset_get (changeset, "/a/b/x/y", &value));
+  g_assert_null (value);
+  g_assert_true (dconf_changeset_get (changeset, "/a/f", &value));
+  g_assert_cmpint (g_variant_get_int32 (value), ==, 3);
+  g_variant_unref (value);
+  g_assert_false (dconf_changeset_get (changeset, "/a/h", NULL));
+
+  /* A write below the reset dir takes precedence over the reset */
+  dconf_changeset_set (changeset, "/a/b/c", g_variant_new_int32 (5));
+  g_assert_true (dconf_changeset_get (changeset, "/a/b/c", &value));
+  g_assert_cmpint (g_variant_get_int32 (value), ==, 5);
+  g_variant_unref (value);
+
+  /* ...until the parent dir gets reset */
+  dconf_changeset_set (changeset, "/a/", NULL);
+  g_assert_cmpuint (dconf_changeset_describe (changeset, NULL, NULL, NULL), ==, 2);
+  g_assert_true (dconf_changeset_get (changeset, "/a/b/c", &value));
+  g_assert_null (value);
+  g_assert_true (dconf_changeset_get (changeset, "/g", &value));
+  g_assert_cmpint (g_variant_get_int32 (value), ==, 4);
+  g_variant_unref (value);
+  g_assert_false (dconf_changeset_get (changeset, "/h", NULL));
+
+  /* A reset is only effective against a database if something is
+   * actually there to be reset.
+   */
+  database = dconf_changeset_new_database (NULL);
+  dconf_changeset_set (database, "/a/b/c", g_variant_new_int32 (1));
+  dconf_changeset_set (database, "/x/y", g_variant_new_int32 (1));
+  dconf_changeset_set (database, "/x/y", NULL);
+
+  filtered = dconf_changeset_filter_changes (database, changeset);
+  g_assert_nonnull (filtered);
+  g_assert_true (dconf_changeset_get (filtered, "/a/", NULL));
+  g_assert_true (dconf_changeset_get (filtered, "/g", NULL));
+  dconf_changeset_unref (filtered);
+
+  dconf_changeset_unref (changeset);
+  changeset = dconf_changeset_new_write ("/x/", NULL);
+  g_assert_null (dconf_changeset_filter_changes (database, changeset));
+
+  dconf_changeset_set (database, "/a/", NULL);
+  g_assert_true (dconf_changeset_is_empty (database));
+
+  dconf_changeset_unref (changeset);
+  dconf_changeset_unref (database);
+}
+
 static gboolean
 has_same_value (const gchar *key,
                 GVariant    *value,
@@ -404,6 +473,83 @@ test_serialiser (void)
   dconf_changeset_unref (changeset);
 }
 
+static void
+test_serialiser_modify (void)
+{
+  DConfChangeset *changeset;
+  GVariant *serialised;
+  GVariant *value;
+
+  changeset = dconf_changeset_new ();
+  dconf_changeset_set (changeset, "/a/b", g_variant_new_string ("b"));
+  dconf_changeset_set (changeset, "/a/c", NULL);
+  dconf_changeset_set (changeset, "/d/", NULL);
+  serialised = g_variant_ref_sink (dconf_changeset_serialise (changeset));
+  dconf_changeset_unref (changeset);
+
+  /* Send it through the bytes, like the service receives it */
+  value = g_variant_new_from_data (G_VARIANT_TYPE ("a{smv}"),
+                                   g_variant_get_data (serialised),
+                                   g_variant_get_size (serialised),
+                                   FALSE, (GDestroyNotify) g_variant_unref,
+                                   g_variant_ref (serialised));
+  g_variant_ref_sink (value);
+  g_variant_unref (serialised);
+
+  changeset = dconf_changeset_deserialise (value);
+  g_variant_unref (value);
+
+  /* Modifying the changeset must not disturb the existing entries */
+  dconf_changeset_set (changeset, "/e", g_variant_new_int32 (1));
+  dconf_changeset_set (changeset, "/a/c", g_variant_new_int32 (2));
+
+  g_assert_true (dconf_changeset_get (changeset, "/a/b", &value));
+  g_assert_cmpstr (g_variant_get_string (value, NULL), ==, "b");
+  g_variant_unref (value);
+  g_assert_true (dconf_changeset_get (changeset, "/a/c", &value));
+  g_assert_cmpint (g_variant_get_int32 (value), ==, 2);
+  g_variant_unref (value);
+  g_assert_true (dconf_changeset_get (changeset, "/d/x", &value));
+  g_assert_null (value);
+  g_assert_cmpuint (dconf_changeset_describe (changeset, NULL, NULL, NULL), ==, 4);
+
+  dconf_changeset_unref (changeset);
+}
+
+static void
+test_serialiser_tree_form (void)
+{
+  DConfChangeset *changeset;
+  GVariant *serialised;
+  GVariant *value;
+
+  changeset = dconf_changeset_new ();
+  dconf_changeset_set (changeset, "/a/b", g_variant_new_string ("b"));
+  dconf_changeset_set (changeset, "/a/c", NULL);
+  dconf_changeset_set (changeset, "/d/", NULL);
+  serialised = g_variant_ref_sink (dconf_changeset_serialise (changeset));
+  dconf_changeset_unref (changeset);
+
+  changeset = dconf_changeset_deserialise (serialised);
+
+  /* Serialising the tree-form variant afterwards must not invalidate
+   * the keys held by the changeset.
+   */
+  g_assert_nonnull (g_variant_get_data (serialised));
+  g_variant_unref (serialised);
+
+  g_assert_true (dconf_changeset_get (changeset, "/a/b", &value));
+  g_assert_cmpstr (g_variant_get_string (value, NULL), ==, "b");
+  g_variant_unref (value);
+  g_assert_true (dconf_changeset_get (changeset, "/a/c", &value));
+  g_assert_null (value);
+  g_assert_true (dconf_changeset_get (changeset, "/d/x", &value));
+  g_assert_null (value);
+  g_assert_cmpuint (dconf_changeset_describe (changeset, NULL, NULL, NULL), ==, 3);
+
+  dconf_changeset_unref (changeset);
+}
+
 static void
 test_change (void)
 {
@@ -462,6 +608,156 @@ test_change (void)
   dconf_changeset_unref (dba);
 }
 
+static void
+assert_database_value (DConfChangeset *database,
+                       const gchar    *key,
+                       gint32          expected)
+{
+  GVariant *value;
+
+  if (expected < 0)
+    {
+      g_assert_false (dconf_changeset_get (database, key, NULL));
+      return;
+    }
+
+  g_assert_true (dconf_changeset_get (database, key, &value));
+  g_assert_cmpint (g_variant_get_int32 (value), ==, expected);
+  g_variant_unref (value);
+}
+
+static void
+test_copy_on_write (void)
+{
+  DConfChangeset *a, *b, *c;
+  GVariant *serialised;
+
+  a = dconf_changeset_new_database (NULL);
+  dconf_changeset_set (a, "/x", g_variant_new_int32 (1));
+  dconf_changeset_set (a, "/y", g_variant_new_int32 (2));
+
+  /* Changes to the copy don't show up in the original... */
+  b = dconf_changeset_new_database (a);
+  dconf_changeset_set (b, "/x", g_variant_new_int32 (3));
+  dconf_changeset_set (b, "/y", NULL);
+  dconf_changeset_set (b, "/z", g_variant_new_int32 (4));
+  assert_database_value (a, "/x", 1);
+  assert_database_value (a, "/y", 2);
+  assert_database_value (a, "/z", -1);
+  assert_database_value (b, "/x", 3);
+  assert_database_value (b, "/y", -1);
+  assert_database_value (b, "/z", 4);
+
+  /* ...nor the other way around */
+  c = dconf_changeset_new_database (b);
+  dconf_changeset_set (a, "/x", NULL);
+  dconf_changeset_set (b, "/z", NULL);
+  dconf_changeset_set (c, "/y", g_variant_new_int32 (5));
+  assert_database_value (a, "/x", -1);
+  assert_database_value (b, "/x", 3);
+  assert_database_value (b, "/y", -1);
+  assert_database_value (b, "/z", -1);
+  assert_database_value (c, "/x", 3);
+  assert_database_value (c, "/y", 5);
+  assert_database_value (c, "/z", 4);
+
+  /* Releasing the original must not affect the copies */
+  dconf_changeset_unref (a);
+  g_assert_false (dconf_changeset_is_empty (b));
+  dconf_changeset_set (b, "/x", NULL);
+  g_assert_true (dconf_changeset_is_empty (b));
+  assert_database_value (c, "/x", 3);
+
+  serialised = dconf_changeset_serialise (c);
+  g_assert_cmpuint (g_variant_n_children (serialised), ==, 3);
+  g_variant_unref (g_variant_ref_sink (serialised));
+
+  /* A dir reset on a copy works on the whole contents */
+  dconf_changeset_set (c, "/", NULL);
+  g_assert_true (dconf_changeset_is_empty (c));
+
+  dconf_changeset_unref (b);
+  dconf_changeset_unref (c);
+}
+
+static gboolean
+find_path (const gchar *path,
+           GVariant    *value,
+           gpointer     user_data)
+{
+  const gchar **found = user_data;
+
+  if (g_str_equal (path, found[0]))
+    found[1] = path;
+
+  return TRUE;
+}
+
+static void
+test_copy_on_write_dir_reset (void)
+{
+  const gchar *found[2] = { "/a/x", NULL };
+  DConfChangeset *changes;
+  DConfChangeset *result;
+  DConfChangeset *a, *b;
+  const gchar *key;
+
+  a = dconf_changeset_new_database (NULL);
+  dconf_changeset_set (a, "/a/x", g_variant_new_int32 (1));
+  dconf_changeset_set (a, "/a/y", g_variant_new_int32 (2));
+  dconf_changeset_set (a, "/a/b/z", g_variant_new_int32 (3));
+  dconf_changeset_set (a, "/c/w", g_variant_new_int32 (4));
+
+  dconf_changeset_all (a, find_path, found);
+  key = found[1];
+  g_assert_nonnull (key);
+
+  /* The contents of 'a' move into a snapshot shared with 'b' */
+  b = dconf_changeset_new_database (a);
+  dconf_changeset_set (b, "/a/v", g_variant_new_int32 (5));
+  dconf_changeset_set (b, "/a/", NULL);
+
+  /* Nothing is left in /a/ to reset, but there is in /c/ */
+  changes = dconf_changeset_new ();
+  dconf_changeset_set (changes, "/a/", NULL);
+  g_assert_null (dconf_changeset_filter_changes (b, changes));
+  dconf_changeset_set (changes, "/c/", NULL);
+  result = dconf_changeset_filter_changes (b, changes);
+  g_assert_nonnull (result);
+  g_assert_false (dconf_changeset_get (result, "/a/", NULL));
+  g_assert_true (dconf_changeset_get (result, "/c/", NULL));
+  dconf_changeset_unref (result);
+  dconf_changeset_unref (changes);
+
+  /* If 'b' had flattened itself then 'a' would now be the only user of
+   * the snapshot, and would get its original table (and keys) back
+   * instead of a copy.
+   */
+  found[1] = NULL;
+  dconf_changeset_all (a, find_path, found);
+  g_assert_nonnull (found[1]);
+  g_assert_true (found[1] != key);
+
+  assert_database_value (a, "/a/x", 1);
+  assert_database_value (a, "/a/y", 2);
+  assert_database_value (a, "/a/b/z", 3);
+  assert_database_value (a, "/a/v", -1);
+  assert_database_value (a, "/c/w", 4);
+  assert_database_value (b, "/a/x", -1);
+  assert_database_value (b, "/a/y", -1);
+  assert_database_value (b, "/a/b/z", -1);
+  assert_database_value (b, "/a/v", -1);
+  assert_database_value (b, "/c/w", 4);
+
+  /* Keys can come back after the reset */
+  dconf_changeset_set (b, "/a/b/z", g_variant_new_int32 (6));
+  assert_database_value (b, "/a/b/z", 6);
+  assert_database_value (a, "/a/b/z", 3);
+
+  dconf_changeset_unref (a);
+  dconf_changeset_unref (b);
+}
+
 static void
 assert_diff_change_invariant (DConfChangeset *from,
                               DConfChangeset *to)
@@ -720,8 +1016,13 @@ main (int argc, char **argv)
   g_test_add_func ("/changeset/similarity", test_similarity);
   g_test_add_func ("/changeset/describe", test_describe);
   g_test_add_func ("/changeset/reset", test_reset);
+  g_test_add_func ("/changeset/reset/nested", test_reset_nested);
   g_test_add_func ("/changeset/serialiser", test_serialiser);
+  g_test_add_func ("/changeset/serialiser/modify", test_serialiser_modify);
+  g_test_add_func ("/changeset/serialiser/tree-form", test_serialiser_tree_form);
   g_test_add_func ("/changeset/change", test_change);
+  g_test_add_func ("/changeset/copy-on-write", test_copy_on_write);
+  g_test_add_func ("/changeset/copy-on-write/dir-reset", test_copy_on_write_dir_reset);
   g_test_add_func ("/changeset/diff", test_diff);
   g_test_add_func ("/changeset/filter", test_filter_changes);
 
@@ -216,6 +216,18 @@ test_coalesce (void)
       check_and_free (dconf_client_read (client, "/test/a"), a == 0 ? NULL : g_variant_new_int32 (a));
       check_and_free (dconf_client_read (client, "/test/b"), b == 0 ? NULL : g_variant_new_int32 (b));
       check_and_free (dconf_client_read (client, "/test/c"), c == 0 ? NULL : g_variant_new_int32 (c));
+
+      /* ...and the same in a single batch */
+      {
+        const gchar * const keys[] = { "/test/a", "/test/b", "/test/c", NULL };
+        GVariant **values;
+
+        values = dconf_client_read_many (client, keys, DCONF_READ_FLAGS_NONE, NULL);
+        check_and_free (values[0], a == 0 ? NULL : g_variant_new_int32 (a));
+        check_and_free (values[1], b == 0 ? NULL : g_variant_new_int32 (b));
+        check_and_free (values[2], c == 0 ? NULL : g_variant_new_int32 (c));
+        g_free (values);
+      }
     }
 
   dconf_mock_dbus_async_reply (g_variant_new ("(s)", "1"), NULL);
@@ -229,6 +241,131 @@ test_coalesce (void)
   g_signal_handlers_disconnect_by_func (client, changed, NULL);
 }
 
+static void
+change_async_done (GObject      *source,
+                   GAsyncResult *result,
+                   gpointer      user_data)
+{
+  GAsyncResult **result_out = user_data;
+
+  g_assert_true (g_thread_self () == main_thread);
+  g_assert_null (*result_out);
+
+  *result_out = g_object_ref (result);
+}
+
+static GAsyncResult *
+wait_for_result (GAsyncResult **result)
+{
+  while (*result == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  return *result;
+}
+
+static void
+test_change_async (void)
+{
+  g_autoptr(DConfClient) client = NULL;
+  DConfChangeset *changeset;
+  GCancellable *cancellable;
+  GAsyncResult *result;
+  GError *error = NULL;
+  gchar *tag = NULL;
+
+  client = dconf_client_new ();
+
+  /* Successful write: the tag from the service is passed through */
+  result = NULL;
+  changeset = dconf_changeset_new_write ("/test/a", g_variant_new_int32 (1));
+  dconf_client_change_async (client, changeset, NULL, change_async_done, &result);
+  dconf_changeset_unref (changeset);
+
+  /* Nothing completes until the service replies */
+  g_main_context_iteration (NULL, FALSE);
+  g_assert_null (result);
+
+  dconf_mock_dbus_async_reply (g_variant_new ("(s)", "tag-a"), NULL);
+  g_assert_true (dconf_client_change_finish (client, wait_for_result (&result), &tag, &error));
+  g_assert_no_error (error);
+  g_assert_cmpstr (tag, ==, "tag-a");
+  g_clear_pointer (&tag, g_free);
+  g_clear_object (&result);
+
+  /* Failed write: the error from the service is passed through */
+  changeset = dconf_changeset_new_write ("/test/b", g_variant_new_int32 (2));
+  dconf_client_change_async (client, changeset, NULL, change_async_done, &result);
+  dconf_changeset_unref (changeset);
+
+  error = g_error_new_literal (G_FILE_ERROR, G_FILE_ERROR_NOENT, "--expected error from testcase--");
+  dconf_mock_dbus_async_reply (NULL, error);
+  g_clear_error (&error);
+
+  g_assert_false (dconf_client_change_finish (client, wait_for_result (&result), &tag, &error));
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+  g_assert_null (tag);
+  g_clear_error (&error);
+  g_clear_object (&result);
+
+  /* Cancelled write: completes when the service replies, as cancelled */
+  cancellable = g_cancellable_new ();
+  changeset = dconf_changeset_new_write ("/test/c", g_variant_new_int32 (3));
+  dconf_client_change_async (client, changeset, cancellable, change_async_done, &result);
+  dconf_changeset_unref (changeset);
+
+  g_cancellable_cancel (cancellable);
+  g_main_context_iteration (NULL, FALSE);
+  g_assert_null (result);
+
+  dconf_mock_dbus_async_reply (g_variant_new ("(s)", "tag-c"), NULL);
+  g_assert_false (dconf_client_change_finish (client, wait_for_result (&result), NULL, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_clear_error (&error);
+  g_clear_object (&result);
+  g_object_unref (cancellable);
+
+  /* Empty changeset: completes without going to the service */
+  changeset = dconf_changeset_new ();
+  dconf_client_change_async (client, changeset, NULL, change_async_done, &result);
+  dconf_changeset_unref (changeset);
+  dconf_mock_dbus_assert_no_async ();
+
+  g_assert_true (dconf_client_change_finish (client, wait_for_result (&result), &tag, &error));
+  g_assert_no_error (error);
+  g_clear_pointer (&tag, g_free);
+  g_clear_object (&result);
+}
+
+static void
+test_read_cache_stats (void)
+{
+  DConfClient *client;
+  guint64 hits, misses;
+  gint i;
+
+  g_setenv ("DCONF_READ_CACHE_SIZE", "16", TRUE);
+  client = dconf_client_new ();
+  g_unsetenv ("DCONF_READ_CACHE_SIZE");
+
+  dconf_client_get_read_cache_stats (client, &hits, &misses);
+  g_assert_cmpuint (hits, ==, 0);
+  g_assert_cmpuint (misses, ==, 0);
+
+  for (i = 0; i < 3; i++)
+    check_and_free (dconf_client_read (client, "/test/value"), NULL);
+
+  dconf_client_get_read_cache_stats (client, &hits, &misses);
+  g_assert_cmpuint (hits, ==, 2);
+  g_assert_cmpuint (misses, ==, 1);
+
+  /* Either count may be omitted */
+  hits = 0;
+  dconf_client_get_read_cache_stats (client, &hits, NULL);
+  g_assert_cmpuint (hits, ==, 2);
+
+  g_object_unref (client);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -241,6 +378,8 @@ main (int argc, char **argv)
   g_test_add_func ("/client/lifecycle", test_lifecycle);
   g_test_add_func ("/client/basic-fast", test_fast);
   g_test_add_func ("/client/coalesce", test_coalesce);
+  g_test_add_func ("/client/change-async", test_change_async);
+  g_test_add_func ("/client/read-cache-stats", test_read_cache_stats);
 
   return g_test_run ();
 }
@@ -154,6 +154,24 @@ gvdb_table_get_value (GvdbTable   *table,
   return (item && item->value) ? g_variant_ref (item->value) : NULL;
 }
 
+gboolean
+gvdb_table_has_value_hashed (GvdbTable   *table,
+                             const gchar *key,
+                             guint        key_length,
+                             guint32      hash_value)
+{
+  return gvdb_table_has_value (table, key);
+}
+
+GVariant *
+gvdb_table_get_value_hashed (GvdbTable   *table,
+                             const gchar *key,
+                             guint        key_length,
+                             guint32      hash_value)
+{
+  return gvdb_table_get_value (table, key);
+}
+
 gchar **
 gvdb_table_list (GvdbTable   *table,
                  const gchar *key)
@@ -168,6 +186,43 @@ gvdb_table_list (GvdbTable   *table,
   return g_strdupv ((gchar **) result);
 }
 
+gboolean
+gvdb_table_peek_value (GvdbTable           *table,
+                       const gchar         *key,
+                       const GVariantType **type,
+                       gconstpointer       *data,
+                       gsize               *size,
+                       gpointer             scratch,
+                       gsize                scratch_size)
+{
+  DConfMockGvdbItem *item;
+
+  item = g_hash_table_lookup (table->table, key);
+
+  if (item == NULL || item->value == NULL)
+    return FALSE;
+
+  *type = g_variant_get_type (item->value);
+  *data = g_variant_get_data (item->value);
+  *size = g_variant_get_size (item->value);
+
+  return TRUE;
+}
+
+gboolean
+gvdb_table_peek_value_hashed (GvdbTable           *table,
+                              const gchar         *key,
+                              guint                key_length,
+                              guint32              hash_value,
+                              const GVariantType **type,
+                              gconstpointer       *data,
+                              gsize               *size,
+                              gpointer             scratch,
+                              gsize                scratch_size)
+{
+  return gvdb_table_peek_value (table, key, type, data, size, scratch, scratch_size);
+}
+
 gchar **
 gvdb_table_get_names (GvdbTable *table,
                       gsize     *length)
@@ -178,6 +233,13 @@ gvdb_table_get_names (GvdbTable *table,
   return g_new0 (gchar *, 0 + 1);
 }
 
+void
+gvdb_table_foreach_name (GvdbTable         *table,
+                         GvdbTableNameFunc  func,
+                         gpointer           user_data)
+{
+}
+
 GvdbTable *
 gvdb_table_new (const gchar  *filename,
                 gboolean      trusted,
@@ -802,6 +802,28 @@ check_read (DConfEngine *engine,
   else
     g_assert_null (value);
 
+  /* A batched read should see the same thing */
+  {
+    const gchar * const keys[] = { "/value", "/missing", "/value" };
+    GVariant **values;
+
+    values = dconf_engine_read_many (engine, DCONF_READ_FLAGS_NONE, NULL, keys, G_N_ELEMENTS (keys));
+
+    for (i = 0; i < G_N_ELEMENTS (keys); i++)
+      {
+        if (i == 1 || expected == -1)
+          g_assert_null (values[i]);
+        else
+          {
+            g_assert_true (g_variant_is_of_type (values[i], G_VARIANT_TYPE_UINT32));
+            g_assert_cmpint (g_variant_get_uint32 (values[i]), ==, expected);
+            g_variant_unref (values[i]);
+          }
+      }
+
+    g_free (values);
+  }
+
   /* We are writable if the first database is a user database and we
    * didn't encounter any locks...
    */
@@ -1463,6 +1485,97 @@ test_watch_sync (void)
   match_request_type = NULL;
 }
 
+static GString *match_rule_log;
+
+static GVariant *
+log_match_request (GBusType             bus_type,
+                   const gchar         *bus_name,
+                   const gchar         *object_path,
+                   const gchar         *interface_name,
+                   const gchar         *method_name,
+                   GVariant            *parameters,
+                   const GVariantType  *expected_type,
+                   GError             **error)
+{
+  const gchar *match_rule;
+  const gchar *arg0path;
+
+  g_variant_get (parameters, "(&s)", &match_rule);
+  arg0path = strstr (match_rule, "arg0path='");
+  g_assert_nonnull (arg0path);
+  arg0path += strlen ("arg0path='");
+
+  /* Only log one of the two sources, to keep things short */
+  if (bus_type == G_BUS_TYPE_SESSION)
+    g_string_append_printf (match_rule_log, "%s:%.*s;", method_name,
+                            (gint) (strchr (arg0path, '\'') - arg0path), arg0path);
+
+  return g_variant_new ("()");
+}
+
+static void
+test_watch_fold (void)
+{
+  DConfEngine *engine;
+
+  /**
+   * Test that watches below a watched dir share its match rule, and
+   * that they get their own rules back when the dir is unwatched.
+   */
+  dconf_mock_dbus_sync_call_handler = log_match_request;
+  match_rule_log = g_string_new (NULL);
+
+  engine = dconf_engine_new (SRCDIR "/profile/dos", NULL, NULL);
+
+  dconf_engine_watch_sync (engine, "/a/b/c");
+  g_assert_cmpstr (match_rule_log->str, ==, "AddMatch:/a/b/c;");
+  g_string_set_size (match_rule_log, 0);
+
+  /* Watching the parent dir takes over the rule, in the safe order */
+  dconf_engine_watch_sync (engine, "/a/");
+  g_assert_cmpstr (match_rule_log->str, ==, "AddMatch:/a/;RemoveMatch:/a/b/c;");
+  g_string_set_size (match_rule_log, 0);
+
+  /* Paths below /a/ need no rules of their own now */
+  dconf_engine_watch_sync (engine, "/a/b/d");
+  dconf_engine_watch_sync (engine, "/a/b/c");
+  dconf_engine_watch_sync (engine, "/a/");
+  dconf_engine_unwatch_sync (engine, "/a/b/d");
+  dconf_engine_unwatch_sync (engine, "/a/");
+  g_assert_cmpstr (match_rule_log->str, ==, "");
+
+  /* ...but other paths do */
+  dconf_engine_watch_sync (engine, "/a");
+  g_assert_cmpstr (match_rule_log->str, ==, "AddMatch:/a;");
+  g_string_set_size (match_rule_log, 0);
+
+  /* Unwatching /a/ hands the rule back */
+  dconf_engine_unwatch_sync (engine, "/a/");
+  g_assert_cmpstr (match_rule_log->str, ==, "AddMatch:/a/b/c;RemoveMatch:/a/;");
+  g_string_set_size (match_rule_log, 0);
+
+  dconf_engine_unwatch_sync (engine, "/a/b/c");
+  g_assert_cmpstr (match_rule_log->str, ==, "");
+  dconf_engine_unwatch_sync (engine, "/a/b/c");
+  g_assert_cmpstr (match_rule_log->str, ==, "RemoveMatch:/a/b/c;");
+  g_string_set_size (match_rule_log, 0);
+  dconf_engine_unwatch_sync (engine, "/a");
+  g_assert_cmpstr (match_rule_log->str, ==, "RemoveMatch:/a;");
+  g_string_set_size (match_rule_log, 0);
+
+  /* The root dir covers everything */
+  dconf_engine_watch_sync (engine, "/");
+  dconf_engine_watch_sync (engine, "/x/y/z");
+  dconf_engine_unwatch_sync (engine, "/x/y/z");
+  dconf_engine_unwatch_sync (engine, "/");
+  g_assert_cmpstr (match_rule_log->str, ==, "AddMatch:/;RemoveMatch:/;");
+
+  dconf_engine_unref (engine);
+  g_string_free (match_rule_log, TRUE);
+  match_rule_log = NULL;
+  dconf_mock_dbus_sync_call_handler = NULL;
+}
+
 static void
 test_change_fast (void)
 {
@@ -1872,6 +1985,94 @@ test_change_sync (void)
   dconf_engine_unref (engine);
 }
 
+static void
+change_async_done (DConfEngine  *engine,
+                   const gchar  *tag,
+                   const GError *error,
+                   gpointer      user_data)
+{
+  GString *log = user_data;
+
+  if (error)
+    g_string_append_printf (log, "error:%s;", error->message);
+  else
+    g_string_append_printf (log, "tag:%s;", tag);
+}
+
+static void
+test_change_async (void)
+{
+  DConfChangeset *empty, *good_write, *bad_write, *very_good_write;
+  GvdbTable *table, *locks;
+  DConfEngine *engine;
+  gboolean success;
+  GError *error = NULL;
+  GString *log;
+
+  table = dconf_mock_gvdb_table_new ();
+  locks = dconf_mock_gvdb_table_new ();
+  dconf_mock_gvdb_table_insert (locks, "/locked", g_variant_new_boolean (TRUE), NULL);
+  dconf_mock_gvdb_table_insert (table, ".locks", NULL, locks);
+  dconf_mock_gvdb_install (SYSCONFDIR "/dconf/db/site", table);
+
+  empty = dconf_changeset_new ();
+  good_write = dconf_changeset_new_write ("/value", g_variant_new_string ("value"));
+  bad_write = dconf_changeset_new_write ("/locked", g_variant_new_string ("value"));
+  very_good_write = dconf_changeset_new_write ("/value", g_variant_new_string ("value"));
+  dconf_changeset_set (very_good_write, "/to-reset", NULL);
+
+  log = g_string_new (NULL);
+  engine = dconf_engine_new (SRCDIR "/profile/dos", NULL, NULL);
+
+  /* Empty changesets complete immediately, without D-Bus traffic */
+  success = dconf_engine_change_async (engine, empty, change_async_done, log, &error);
+  g_assert_no_error (error);
+  g_assert_true (success);
+  g_assert_cmpstr (log->str, ==, "tag:;");
+  g_string_set_size (log, 0);
+
+  /* Non-writable changes fail synchronously and never call back */
+  success = dconf_engine_change_async (engine, bad_write, change_async_done, log, &error);
+  g_assert_error (error, DCONF_ERROR, DCONF_ERROR_NOT_WRITABLE);
+  g_clear_error (&error);
+  g_assert_false (success);
+  dconf_mock_dbus_assert_no_async ();
+  g_assert_cmpstr (log->str, ==, "");
+
+  /* Several changes can be outstanding at once, and nothing is
+   * reported until the service replies
+   */
+  success = dconf_engine_change_async (engine, good_write, change_async_done, log, &error);
+  g_assert_no_error (error);
+  g_assert_true (success);
+  success = dconf_engine_change_async (engine, very_good_write, change_async_done, log, &error);
+  g_assert_no_error (error);
+  g_assert_true (success);
+  g_assert_cmpstr (log->str, ==, "");
+
+  /* Async changes do not use the fast-write queue */
+  g_assert_false (dconf_engine_has_outstanding (engine));
+
+  dconf_mock_dbus_async_reply (g_variant_new ("(s)", "tag1"), NULL);
+  g_assert_cmpstr (log->str, ==, "tag:tag1;");
+  g_string_set_size (log, 0);
+
+  error = g_error_new_literal (G_FILE_ERROR, G_FILE_ERROR_NOENT, "something failed");
+  dconf_mock_dbus_async_reply (NULL, error);
+  g_clear_error (&error);
+  g_assert_cmpstr (log->str, ==, "error:something failed;");
+  g_string_set_size (log, 0);
+
+  dconf_mock_dbus_assert_no_async ();
+
+  dconf_changeset_unref (empty);
+  dconf_changeset_unref (good_write);
+  dconf_changeset_unref (very_good_write);
+  dconf_changeset_unref (bad_write);
+  dconf_engine_unref (engine);
+  g_string_free (log, TRUE);
+}
+
 static void
 send_signal (GBusType     type,
              const gchar *name,
@@ -1886,6 +2087,164 @@ send_signal (GBusType     type,
   g_variant_unref (value);
 }
 
+/**
+ * Tests that the no-op detection in dconf_engine_change_fast() also
+ * takes the contents of the user database into account, for changesets
+ * with several keys at once.
+ */
+static void
+test_change_fast_redundant_database (void)
+{
+  /* (byte 1, uint32 5) with non-zero padding, which is not normal form */
+  guint8 tuple_data[8] = { 1, 0xff, 0xff, 0xff };
+  guint32 five = 5;
+  DConfChangeset *change;
+  DConfEngine *engine;
+  GvdbTable *table;
+  GBytes *bytes;
+
+  change_log = g_string_new (NULL);
+
+  table = dconf_mock_gvdb_table_new ();
+  dconf_mock_gvdb_table_insert (table, "/value", g_variant_new_string ("value"), NULL);
+  dconf_mock_gvdb_table_insert (table, "/tuple", g_variant_new ("(yu)", 1, 5), NULL);
+  dconf_mock_gvdb_install ("/HOME/.config/dconf/user", table);
+
+  engine = dconf_engine_new (SRCDIR "/profile/dos", NULL, NULL);
+
+  // Set value to its current value and reset a key that is already unset
+  change = dconf_changeset_new_write ("/value", g_variant_new_string ("value"));
+  dconf_changeset_set (change, "/other", NULL);
+  dconf_engine_change_fast (engine, change, NULL, NULL);
+  dconf_changeset_unref (change);
+  g_assert_cmpstr (change_log->str, ==, "");
+  dconf_mock_dbus_assert_no_async ();
+
+  // An equal value that is serialised differently is not a change either
+  memcpy (tuple_data + 4, &five, sizeof five);
+  bytes = g_bytes_new (tuple_data, sizeof tuple_data);
+  change = dconf_changeset_new_write ("/tuple", g_variant_new_from_bytes (G_VARIANT_TYPE ("(yu)"), bytes, FALSE));
+  g_bytes_unref (bytes);
+  dconf_engine_change_fast (engine, change, NULL, NULL);
+  dconf_changeset_unref (change);
+  g_assert_cmpstr (change_log->str, ==, "");
+  dconf_mock_dbus_assert_no_async ();
+
+  // The same data with a different type is a change
+  change = dconf_changeset_new_write ("/value", g_variant_new_object_path ("/value"));
+  dconf_changeset_set (change, "/other", NULL);
+  dconf_engine_change_fast (engine, change, NULL, NULL);
+  dconf_changeset_unref (change);
+  g_assert_cmpstr (change_log->str, ==, "/:2:other,value:nil;");
+  g_string_set_size (change_log, 0);
+
+  // Repeating it has no effect because of the in-flight change
+  change = dconf_changeset_new_write ("/value", g_variant_new_object_path ("/value"));
+  dconf_engine_change_fast (engine, change, NULL, NULL);
+  dconf_changeset_unref (change);
+  g_assert_cmpstr (change_log->str, ==, "");
+
+  // Reset the root directory, which has an effect because of the in-flight change
+  change = dconf_changeset_new_write ("/", NULL);
+  dconf_engine_change_fast (engine, change, NULL, NULL);
+  dconf_changeset_unref (change);
+  g_assert_cmpstr (change_log->str, ==, "/:1::nil;");
+  g_string_set_size (change_log, 0);
+
+  // Now the pending reset overrides both the in-flight change and the database
+  change = dconf_changeset_new_write ("/", NULL);
+  dconf_changeset_set (change, "/value", NULL);
+  dconf_engine_change_fast (engine, change, NULL, NULL);
+  dconf_changeset_unref (change);
+  g_assert_cmpstr (change_log->str, ==, "");
+
+  dconf_mock_dbus_async_reply (g_variant_new ("(s)", "tag1"), NULL);
+  dconf_mock_dbus_async_reply (g_variant_new ("(s)", "tag2"), NULL);
+  dconf_mock_dbus_assert_no_async ();
+
+  dconf_mock_gvdb_install ("/HOME/.config/dconf/user", NULL);
+  dconf_engine_unref (engine);
+  g_string_free (change_log, TRUE);
+  change_log = NULL;
+}
+
+static void
+test_change_fast_depth (void)
+{
+  DConfChangeset *change;
+  DConfEngine *engine;
+  GError *error = NULL;
+  GVariant *value;
+  gint i;
+
+  change_log = g_string_new (NULL);
+
+  g_setenv ("DCONF_FAST_WRITE_DEPTH", "2", TRUE);
+  engine = dconf_engine_new (SRCDIR "/profile/dos", NULL, NULL);
+  g_unsetenv ("DCONF_FAST_WRITE_DEPTH");
+
+  /* The first two writes go straight onto the wire and the rest are
+   * merged together while waiting for a free slot.
+   */
+  for (i = 0; i < 4; i++)
+    {
+      change = dconf_changeset_new_write ("/value", g_variant_new_int32 (i));
+      if (i != 1)
+        dconf_changeset_set (change, "/other", g_variant_new_int32 (i));
+      g_assert_true (dconf_engine_change_fast (engine, change, NULL, NULL));
+      dconf_changeset_unref (change);
+    }
+  g_string_set_size (change_log, 0);
+
+  /* Reads see the newest value */
+  value = dconf_engine_read (engine, DCONF_READ_FLAGS_NONE, NULL, "/value");
+  g_assert_cmpint (g_variant_get_int32 (value), ==, 3);
+  g_variant_unref (value);
+
+  /* Complete the first write.  That sends the pending one. */
+  dconf_mock_dbus_async_reply (g_variant_new ("(s)", "tag0"), NULL);
+  g_assert_cmpstr (change_log->str, ==, "");
+  g_assert_true (dconf_engine_has_outstanding (engine));
+
+  /* Fail the second write.  Its keys are reported as changed, but the
+   * value of /value still comes from the newer write.
+   */
+  error = g_error_new_literal (G_FILE_ERROR, G_FILE_ERROR_NOENT, "something failed");
+  dconf_mock_dbus_async_reply (NULL, error);
+  g_clear_error (&error);
+  g_assert_cmpstr (change_log->str, ==, "/value:1::nil;");
+  g_string_set_size (change_log, 0);
+  assert_pop_message ("dconf", G_LOG_LEVEL_WARNING, "failed to commit changes to dconf: something failed");
+
+  value = dconf_engine_read (engine, DCONF_READ_FLAGS_NONE, NULL, "/value");
+  g_assert_cmpint (g_variant_get_int32 (value), ==, 3);
+  g_variant_unref (value);
+  value = dconf_engine_read (engine, DCONF_READ_FLAGS_NONE, NULL, "/other");
+  g_assert_cmpint (g_variant_get_int32 (value), ==, 3);
+  g_variant_unref (value);
+
+  /* Complete the merged write */
+  dconf_mock_dbus_async_reply (g_variant_new ("(s)", "tag2"), NULL);
+  dconf_mock_dbus_assert_no_async ();
+  g_assert_false (dconf_engine_has_outstanding (engine));
+
+  value = dconf_engine_read (engine, DCONF_READ_FLAGS_NONE, NULL, "/value");
+  g_assert_null (value);
+
+  /* The signals for both successful writes are ignored, even though
+   * they arrive after both replies.  Others still come through.
+   */
+  send_signal (G_BUS_TYPE_SESSION, ":1.123", "/ca/desrt/dconf/Writer/user", "Notify", "('/value', [''], 'tag0')");
+  send_signal (G_BUS_TYPE_SESSION, ":1.123", "/ca/desrt/dconf/Writer/user", "Notify", "('/value', [''], 'tag2')");
+  g_assert_cmpstr (change_log->str, ==, "");
+  send_signal (G_BUS_TYPE_SESSION, ":1.123", "/ca/desrt/dconf/Writer/user", "Notify", "('/value', [''], 'tag3')");
+  g_assert_cmpstr (change_log->str, ==, "/value:1::tag3;");
+
+  dconf_engine_unref (engine);
+  g_string_free (change_log, TRUE);
+  change_log = NULL;
+}
+
 static void
 test_signals (void)
 {
@@ -1980,6 +2339,54 @@ test_signals (void)
   dconf_engine_unref (engine);
 }
 
+static void
+test_signals_dispatch (void)
+{
+  DConfEngine *dos1, *dos2, *test;
+
+  /**
+   * Test that signals reach exactly the engines that have a source for
+   * the bus and object path they came from, including after some of
+   * them are destroyed.
+   */
+  change_log = g_string_new (NULL);
+
+  dos1 = dconf_engine_new (SRCDIR "/profile/dos", NULL, NULL);
+  dos2 = dconf_engine_new (SRCDIR "/profile/dos", NULL, NULL);
+  test = dconf_engine_new (SRCDIR "/profile/test-profile", NULL, NULL);
+
+  send_signal (G_BUS_TYPE_SESSION, ":1.123", "/ca/desrt/dconf/Writer/user", "Notify", "('/a', [''], 'tag')");
+  g_assert_cmpstr (change_log->str, ==, "/a:1::tag;/a:1::tag;");
+  g_string_set_size (change_log, 0);
+
+  send_signal (G_BUS_TYPE_SYSTEM, ":1.123", "/ca/desrt/dconf/Writer/site", "WritabilityNotify", "('/a',)");
+  g_assert_cmpstr (change_log->str, ==, "w:/a:1::;w:/a:1::;");
+  g_string_set_size (change_log, 0);
+
+  send_signal (G_BUS_TYPE_SESSION, ":1.123", "/ca/desrt/dconf/Writer/test", "Notify", "('/a', [''], 'tag')");
+  g_assert_cmpstr (change_log->str, ==, "/a:1::tag;");
+  g_string_set_size (change_log, 0);
+
+  dconf_engine_unref (dos1);
+
+  send_signal (G_BUS_TYPE_SESSION, ":1.123", "/ca/desrt/dconf/Writer/user", "Notify", "('/a', [''], 'tag')");
+  g_assert_cmpstr (change_log->str, ==, "/a:1::tag;");
+  g_string_set_size (change_log, 0);
+
+  dconf_engine_unref (dos2);
+
+  send_signal (G_BUS_TYPE_SESSION, ":1.123", "/ca/desrt/dconf/Writer/user", "Notify", "('/a', [''], 'tag')");
+  send_signal (G_BUS_TYPE_SYSTEM, ":1.123", "/ca/desrt/dconf/Writer/site", "WritabilityNotify", "('/a',)");
+  g_assert_cmpstr (change_log->str, ==, "");
+
+  send_signal (G_BUS_TYPE_SESSION, ":1.123", "/ca/desrt/dconf/Writer/test", "Notify", "('/a', [''], 'tag')");
+  g_assert_cmpstr (change_log->str, ==, "/a:1::tag;");
+
+  dconf_engine_unref (test);
+  g_string_free (change_log, TRUE);
+  change_log = NULL;
+}
+
 static gboolean it_is_good_to_be_done;
 
 static gpointer
@@ -2084,6 +2491,150 @@ test_sync (void)
   dconf_mock_shm_reset ();
 }
 
+static void
+test_read_cache (void)
+{
+  DConfChangeset *change;
+  GvdbTable *table, *old_table;
+  DConfEngine *engine;
+  guint64 hits, misses;
+  GVariant *value;
+  gint i;
+
+  table = dconf_mock_gvdb_table_new ();
+  dconf_mock_gvdb_table_insert (table, "/value", g_variant_new_uint32 (1), NULL);
+  dconf_mock_gvdb_install (SYSCONFDIR "/dconf/db/site", table);
+  old_table = dconf_mock_gvdb_table_ref (table);
+
+  g_setenv ("DCONF_READ_CACHE_SIZE", "2", TRUE);
+  engine = dconf_engine_new (SRCDIR "/profile/dos", NULL, NULL);
+  g_unsetenv ("DCONF_READ_CACHE_SIZE");
+
+  /* The first read is a miss and the following ones hit */
+  for (i = 0; i < 3; i++)
+    {
+      value = dconf_engine_read (engine, DCONF_READ_FLAGS_NONE, NULL, "/value");
+      g_assert_cmpuint (g_variant_get_uint32 (value), ==, 1);
+      g_variant_unref (value);
+    }
+
+  dconf_engine_get_read_cache_stats (engine, &hits, &misses);
+  g_assert_cmpuint (hits, ==, 2);
+  g_assert_cmpuint (misses, ==, 1);
+
+  /* Missing values are cached too */
+  for (i = 0; i < 2; i++)
+    g_assert_null (dconf_engine_read (engine, DCONF_READ_FLAGS_NONE, NULL, "/missing"));
+
+  dconf_engine_get_read_cache_stats (engine, &hits, &misses);
+  g_assert_cmpuint (hits, ==, 3);
+  g_assert_cmpuint (misses, ==, 2);
+
+  /* Reads with flags are never cached */
+  value = dconf_engine_read (engine, DCONF_READ_DEFAULT_VALUE, NULL, "/value");
+  g_assert_cmpuint (g_variant_get_uint32 (value), ==, 1);
+  g_variant_unref (value);
+
+  dconf_engine_get_read_cache_stats (engine, &hits, &misses);
+  g_assert_cmpuint (hits, ==, 3);
+  g_assert_cmpuint (misses, ==, 2);
+
+  /* Queued changes bypass the cache */
+  change = dconf_changeset_new_write ("/value", g_variant_new_uint32 (2));
+  dconf_engine_change_fast (engine, change, NULL, NULL);
+  dconf_changeset_unref (change);
+
+  value = dconf_engine_read (engine, DCONF_READ_FLAGS_NONE, NULL, "/value");
+  g_assert_cmpuint (g_variant_get_uint32 (value), ==, 2);
+  g_variant_unref (value);
+
+  dconf_engine_get_read_cache_stats (engine, &hits, &misses);
+  g_assert_cmpuint (hits, ==, 3);
+  g_assert_cmpuint (misses, ==, 2);
+
+  /* Complete the write.  Pretend that it went into the site database
+   * (the important part being that a database changes state).
+   */
+  table = dconf_mock_gvdb_table_new ();
+  dconf_mock_gvdb_table_insert (table, "/value", g_variant_new_uint32 (2), NULL);
+  dconf_mock_gvdb_install (SYSCONFDIR "/dconf/db/site", table);
+  dconf_mock_gvdb_table_invalidate (old_table);
+  gvdb_table_free (old_table);
+  dconf_mock_dbus_async_reply (g_variant_new ("(s)", "tag"), NULL);
+
+  value = dconf_engine_read (engine, DCONF_READ_FLAGS_NONE, NULL, "/value");
+  g_assert_cmpuint (g_variant_get_uint32 (value), ==, 2);
+  g_variant_unref (value);
+
+  dconf_engine_get_read_cache_stats (engine, &hits, &misses);
+  g_assert_cmpuint (hits, ==, 3);
+  g_assert_cmpuint (misses, ==, 3);
+
+  dconf_engine_unref (engine);
+  dconf_mock_gvdb_install (SYSCONFDIR "/dconf/db/site", NULL);
+  dconf_mock_shm_reset ();
+}
+
+/* Benchmark for concurrent reads from a number of threads.
+ *
+ * This is the steady state: nothing is queued and no database changes,
+ * so the reads should be able to proceed without contending on any
+ * locks.  Only run in perf mode (ie: -m perf).
+ */
+#define N_READ_THREADS 4
+#define N_READS_PER_THREAD 1000000
+
+static gpointer
+test_read_concurrent_worker (gpointer user_data)
+{
+  DConfEngine *engine = user_data;
+  gint i;
+
+  for (i = 0; i < N_READS_PER_THREAD; i++)
+    {
+      GVariant *value;
+
+      value = dconf_engine_read (engine, DCONF_READ_FLAGS_NONE, NULL, "/value");
+      g_assert_nonnull (value);
+      g_variant_unref (value);
+    }
+
+  return NULL;
+}
+
+static void
+test_read_concurrent (void)
+{
+  GThread *threads[N_READ_THREADS];
+  GvdbTable *table;
+  DConfEngine *engine;
+  gdouble elapsed;
+  gint i;
+
+  table = dconf_mock_gvdb_table_new ();
+  dconf_mock_gvdb_table_insert (table, "/value", g_variant_new_uint32 (1), NULL);
+  dconf_mock_gvdb_install (SYSCONFDIR "/dconf/db/site", table);
+
+  engine = dconf_engine_new (SRCDIR "/profile/dos", NULL, NULL);
+
+  g_test_timer_start ();
+
+  for (i = 0; i < N_READ_THREADS; i++)
+    threads[i] = g_thread_new ("reader", test_read_concurrent_worker, engine);
+
+  for (i = 0; i < N_READ_THREADS; i++)
+    g_thread_join (threads[i]);
+
+  elapsed = g_test_timer_elapsed ();
+  g_test_maximized_result (N_READ_THREADS * N_READS_PER_THREAD / elapsed,
+                           "%d threads: %g reads per second",
+                           N_READ_THREADS, N_READ_THREADS * N_READS_PER_THREAD / elapsed);
+
+  dconf_engine_unref (engine);
+  dconf_mock_gvdb_install (SYSCONFDIR "/dconf/db/site", NULL);
+  dconf_mock_shm_reset ();
+}
+
 /* Log handling. */
 typedef struct
 {
@@ -2234,17 +2785,26 @@ main (int argc, char **argv)
   g_test_add_func ("/engine/sources/file", test_file_source);
   g_test_add_func ("/engine/sources/service", test_service_source);
   g_test_add_func ("/engine/read", test_read);
+  g_test_add_func ("/engine/read/cache", test_read_cache);
   g_test_add_func ("/engine/watch/fast", test_watch_fast);
   g_test_add_func ("/engine/watch/fast/simultaneous", test_watch_fast_simultaneous_subscriptions);
   g_test_add_func ("/engine/watch/fast/successive", test_watch_fast_successive_subscriptions);
   g_test_add_func ("/engine/watch/fast/short_lived", test_watch_fast_short_lived_subscriptions);
   g_test_add_func ("/engine/watch/sync", test_watch_sync);
+  g_test_add_func ("/engine/watch/fold", test_watch_fold);
   g_test_add_func ("/engine/change/fast", test_change_fast);
   g_test_add_func ("/engine/change/fast_redundant", test_change_fast_redundant);
+  g_test_add_func ("/engine/change/fast_redundant/database", test_change_fast_redundant_database);
+  g_test_add_func ("/engine/change/fast/depth", test_change_fast_depth);
   g_test_add_func ("/engine/change/sync", test_change_sync);
+  g_test_add_func ("/engine/change/async", test_change_async);
   g_test_add_func ("/engine/signals", test_signals);
+  g_test_add_func ("/engine/signals/dispatch", test_signals_dispatch);
   g_test_add_func ("/engine/sync", test_sync);
 
+  if (g_test_perf ())
+    g_test_add_func ("/engine/read/concurrent", test_read_concurrent);
+
   retval = g_test_run ();
 
   assert_no_messages ();
@@ -1,4 +1,9 @@
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "../gvdb/gvdb-builder.h"
+#include "../gvdb/gvdb-format.h"
 #include "../gvdb/gvdb-reader.h"
 
 static void
@@ -80,13 +85,24 @@ test_reader_empty (void)
   gvdb_table_free (table);
 }
 
+static void
+collect_name (const gchar *name,
+              gsize        length,
+              gpointer     user_data)
+{
+  g_assert_cmpuint (strlen (name), ==, length);
+  g_ptr_array_add (user_data, g_strdup (name));
+}
+
 static void
 verify_table (GvdbTable *table)
 {
+  GPtrArray *names;
   GVariant *value;
   gchar **list;
   gsize n_names;
   gboolean has;
+  gsize i;
 
   /* We could not normally expect these to be in a particular order but
    * we are using a specific test file that we know to be laid out this
@@ -102,6 +118,14 @@ verify_table (GvdbTable *table)
   g_assert_cmpstr (list[2], ==, "/values/boolean");
   g_assert_cmpstr (list[3], ==, "/values/string");
   g_assert_cmpstr (list[4], ==, "/values/int32");
+
+  /* gvdb_table_foreach_name() must give the same names, in order */
+  names = g_ptr_array_new_with_free_func (g_free);
+  gvdb_table_foreach_name (table, collect_name, names);
+  g_assert_cmpuint (names->len, ==, n_names);
+  for (i = 0; i < n_names; i++)
+    g_assert_cmpstr (names->pdata[i], ==, list[i]);
+  g_ptr_array_unref (names);
   g_strfreev (list);
 
   list = gvdb_table_list (table, "/");
@@ -415,6 +439,400 @@ test_corrupted (gconstpointer user_data)
   g_mapped_file_unref (mapped);
 }
 
+static void
+check_bloom_table (GvdbTable *table,
+                   gint       n_keys)
+{
+  gint i;
+
+  for (i = 0; i < n_keys; i++)
+    {
+      gchar *key = g_strdup_printf ("/key%d", i);
+      GVariant *value;
+      guint32 hash_value;
+      guint key_length;
+
+      value = gvdb_table_get_value (table, key);
+      g_assert_nonnull (value);
+      g_assert_cmpint (g_variant_get_int32 (value), ==, i);
+      g_variant_unref (value);
+
+      hash_value = gvdb_table_hash_key (key, &key_length);
+      g_assert_cmpuint (key_length, ==, strlen (key));
+      g_assert_true (gvdb_table_has_value_hashed (table, key, key_length, hash_value));
+      value = gvdb_table_get_value_hashed (table, key, key_length, hash_value);
+      g_assert_nonnull (value);
+      g_assert_cmpint (g_variant_get_int32 (value), ==, i);
+      g_variant_unref (value);
+      g_free (key);
+    }
+
+  for (i = n_keys; i < 2 * n_keys; i++)
+    {
+      gchar *key = g_strdup_printf ("/key%d", i);
+      guint32 hash_value;
+      guint key_length;
+
+      g_assert_false (gvdb_table_has_value (table, key));
+      hash_value = gvdb_table_hash_key (key, &key_length);
+      g_assert_false (gvdb_table_has_value_hashed (table, key, key_length, hash_value));
+      g_free (key);
+    }
+}
+
+static void
+test_builder_bloom (void)
+{
+  struct gvdb_hash_header *hash_header;
+  const struct gvdb_header *header;
+  const gint n_keys = 1000;
+  GError *error = NULL;
+  GHashTable *builder;
+  GvdbTable *table;
+  GBytes *bytes;
+  gchar *filename;
+  gchar *contents;
+  gsize length;
+  guint32 start;
+  guint32 n_bloom_words;
+  gint fd;
+  gint i;
+
+  fd = g_file_open_tmp ("gvdb-bloom-XXXXXX", &filename, &error);
+  g_assert_no_error (error);
+  close (fd);
+
+  builder = gvdb_hash_table_new (NULL, NULL);
+  for (i = 0; i < n_keys; i++)
+    {
+      gchar *key = g_strdup_printf ("/key%d", i);
+
+      gvdb_item_set_value (gvdb_hash_table_insert (builder, key),
+                           g_variant_new_int32 (i));
+      g_free (key);
+    }
+
+  gvdb_table_write_contents (builder, filename, FALSE, &error);
+  g_assert_no_error (error);
+  g_hash_table_unref (builder);
+
+  /* The root table must carry a non-empty bloom filter */
+  g_file_get_contents (filename, &contents, &length, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (length, >=, sizeof *header);
+  header = (gpointer) contents;
+  start = guint32_from_le (header->root.start);
+  g_assert_cmpuint (start + sizeof *hash_header, <=, length);
+  hash_header = (gpointer) (contents + start);
+  n_bloom_words = guint32_from_le (hash_header->n_bloom_words);
+  g_assert_cmpuint (n_bloom_words & ((1u << 27) - 1), >, 0);
+
+  table = gvdb_table_new (filename, TRUE, &error);
+  g_assert_no_error (error);
+  check_bloom_table (table, n_keys);
+  gvdb_table_free (table);
+
+  /* Readers that ignore the shift must not get false negatives */
+  hash_header->n_bloom_words =
+    guint32_to_le (n_bloom_words & ((1u << 27) - 1));
+  bytes = g_bytes_new_take (contents, length);
+  table = gvdb_table_new_from_bytes (bytes, TRUE, &error);
+  g_assert_no_error (error);
+  check_bloom_table (table, n_keys);
+  gvdb_table_free (table);
+  g_bytes_unref (bytes);
+
+  g_unlink (filename);
+  g_free (filename);
+}
+
+static GBytes *
+write_layout_table (gboolean reverse)
+{
+  const gint n_dirs = 10, n_keys = 10;
+  GError *error = NULL;
+  GHashTable *builder;
+  GHashTable *locks;
+  GvdbItem *root;
+  gchar *filename;
+  gchar *contents;
+  gsize length;
+  gint fd;
+  gint i;
+
+  builder = gvdb_hash_table_new (NULL, NULL);
+  root = gvdb_hash_table_insert (builder, "/");
+
+  for (i = 0; i < n_dirs; i++)
+    {
+      gint d = reverse ? n_dirs - 1 - i : i;
+      gchar *dir = g_strdup_printf ("/dir%d/", d);
+
+      gvdb_item_set_parent (gvdb_hash_table_insert (builder, dir), root);
+      g_free (dir);
+    }
+
+  for (i = 0; i < n_dirs * n_keys; i++)
+    {
+      gint k = reverse ? n_dirs * n_keys - 1 - i : i;
+      gchar *dir = g_strdup_printf ("/dir%d/", k / n_keys);
+      gchar *key = g_strdup_printf ("%skey%d", dir, k % n_keys);
+      GvdbItem *item;
+
+      item = gvdb_hash_table_insert (builder, key);
+      gvdb_item_set_parent (item, g_hash_table_lookup (builder, dir));
+      gvdb_item_set_value (item, g_variant_new_int32 (k));
+      g_free (key);
+      g_free (dir);
+    }
+
+  locks = gvdb_hash_table_new (builder, ".locks");
+  for (i = 0; i < n_dirs; i++)
+    {
+      gchar *key = g_strdup_printf ("/dir%d/key0", reverse ? n_dirs - 1 - i : i);
+
+      gvdb_hash_table_insert_string (locks, key, "");
+      g_free (key);
+    }
+  g_hash_table_unref (locks);
+
+  fd = g_file_open_tmp ("gvdb-layout-XXXXXX", &filename, &error);
+  g_assert_no_error (error);
+  close (fd);
+
+  gvdb_table_write_contents (builder, filename, FALSE, &error);
+  g_assert_no_error (error);
+  g_hash_table_unref (builder);
+
+  g_file_get_contents (filename, &contents, &length, &error);
+  g_assert_no_error (error);
+  g_unlink (filename);
+  g_free (filename);
+
+  return g_bytes_new_take (contents, length);
+}
+
+static void
+test_builder_deterministic (void)
+{
+  GError *error = NULL;
+  GBytes *forward, *backward;
+  GvdbTable *table, *locks;
+  GVariant *value;
+  gchar **names;
+  gsize length;
+
+  /* Identical contents give identical files, whatever the insertion order */
+  forward = write_layout_table (FALSE);
+  backward = write_layout_table (TRUE);
+  g_assert_true (g_bytes_equal (forward, backward));
+  g_bytes_unref (backward);
+
+  table = gvdb_table_new_from_bytes (forward, TRUE, &error);
+  g_assert_no_error (error);
+
+  names = gvdb_table_list (table, "/dir3/");
+  g_assert_nonnull (names);
+  g_assert_cmpuint (g_strv_length (names), ==, 10);
+  g_assert_cmpstr (names[0], ==, "key0");
+  g_assert_cmpstr (names[9], ==, "key9");
+  g_strfreev (names);
+
+  value = gvdb_table_get_value (table, "/dir3/key7");
+  g_assert_nonnull (value);
+  g_assert_cmpint (g_variant_get_int32 (value), ==, 37);
+  g_variant_unref (value);
+
+  locks = gvdb_table_get_table (table, ".locks");
+  g_assert_nonnull (locks);
+  g_assert_true (gvdb_table_has_value (locks, "/dir9/key0"));
+  g_assert_false (gvdb_table_has_value (locks, "/dir9/key1"));
+  gvdb_table_free (locks);
+
+  names = gvdb_table_get_names (table, &length);
+  g_assert_cmpuint (length, ==, 1 + 10 + 100 + 1);
+  g_strfreev (names);
+
+  gvdb_table_free (table);
+  g_bytes_unref (forward);
+}
+
+static const gchar *typed_values[] = {
+  "true", "byte 0xfe", "int16 -2", "uint16 65000", "int32 -123456",
+  "uint32 4000000000", "int64 -1234567890123", "uint64 18000000000000000000",
+  "3.25", "'not inline'", "[1, 2, 3]", "<42>", "['a', 'b']"
+};
+
+/* Writes typed_values[i] as "/key<i>" and opens the result */
+static GvdbTable *
+open_typed_values_table (gboolean        byteswap,
+                         GvdbWriteFlags  flags,
+                         gsize          *file_size)
+{
+  GError *error = NULL;
+  GHashTable *builder;
+  GvdbTable *table;
+  gchar *filename;
+  gsize i;
+  gint fd;
+
+  fd = g_file_open_tmp ("gvdb-typed-XXXXXX", &filename, &error);
+  g_assert_no_error (error);
+  close (fd);
+
+  builder = gvdb_hash_table_new (NULL, NULL);
+  for (i = 0; i < G_N_ELEMENTS (typed_values); i++)
+    {
+      gchar *key = g_strdup_printf ("/key%" G_GSIZE_FORMAT, i);
+      GVariant *value;
+
+      value = g_variant_parse (NULL, typed_values[i], NULL, NULL, &error);
+      g_assert_no_error (error);
+      gvdb_item_set_value (gvdb_hash_table_insert (builder, key), value);
+      g_free (key);
+    }
+
+  gvdb_table_write_contents_with_flags (builder, filename, byteswap, flags, &error);
+  g_assert_no_error (error);
+  g_hash_table_unref (builder);
+
+  if (file_size)
+    {
+      gchar *contents;
+
+      g_file_get_contents (filename, &contents, file_size, &error);
+      g_assert_no_error (error);
+      g_free (contents);
+    }
+
+  table = gvdb_table_new (filename, TRUE, &error);
+  g_assert_no_error (error);
+
+  g_unlink (filename);
+  g_free (filename);
+
+  return table;
+}
+
+static void
+test_builder_inline (void)
+{
+  gsize sizes[2][2];
+  gint byteswap;
+  gint n;
+  gsize i;
+
+  for (n = 0; n < 4; n++)
+    {
+      gint inline_values = n % 2;
+      GvdbWriteFlags flags = inline_values ? GVDB_WRITE_FLAGS_INLINE_VALUES : GVDB_WRITE_FLAGS_NONE;
+      GvdbTable *table;
+
+      byteswap = n / 2;
+
+      table = open_typed_values_table (byteswap, flags, &sizes[byteswap][inline_values]);
+
+      for (i = 0; i < G_N_ELEMENTS (typed_values); i++)
+        {
+          gchar *key = g_strdup_printf ("/key%" G_GSIZE_FORMAT, i);
+          GVariant *expected, *value, *raw;
+
+          expected = g_variant_parse (NULL, typed_values[i], NULL, NULL, NULL);
+          g_variant_ref_sink (expected);
+
+          g_assert_true (gvdb_table_has_value (table, key));
+
+          value = gvdb_table_get_value (table, key);
+          g_assert_nonnull (value);
+          g_assert_false (g_variant_is_floating (value));
+          g_assert_true (g_variant_equal (value, expected));
+
+          /* The raw value is in file byte order */
+          raw = gvdb_table_get_raw_value (table, key);
+          g_assert_nonnull (raw);
+          if (byteswap)
+            {
+              GVariant *swapped = g_variant_byteswap (raw);
+              g_assert_true (g_variant_equal (swapped, expected));
+              g_variant_unref (swapped);
+            }
+          else
+            g_assert_true (g_variant_equal (raw, expected));
+
+          g_variant_unref (raw);
+          g_variant_unref (value);
+          g_variant_unref (expected);
+          g_free (key);
+        }
+
+      gvdb_table_free (table);
+    }
+
+  /* Inline values are opt-in.  Without the flag no 'i' items are
+   * written, so the fixed-size values each take a separate chunk.
+   */
+  for (byteswap = 0; byteswap < 2; byteswap++)
+    g_assert_cmpuint (sizes[byteswap][1], <, sizes[byteswap][0]);
+}
+
+static void
+test_reader_peek (void)
+{
+  gint byteswap;
+  gsize i;
+
+  for (byteswap = 0; byteswap < 2; byteswap++)
+    {
+      GvdbTable *table;
+
+      table = open_typed_values_table (byteswap, GVDB_WRITE_FLAGS_INLINE_VALUES, NULL);
+
+      g_assert_false (gvdb_table_peek_value (table, "/missing", NULL, NULL, NULL, NULL, 0));
+
+      for (i = 0; i < G_N_ELEMENTS (typed_values); i++)
+        {
+          gchar *key = g_strdup_printf ("/key%" G_GSIZE_FORMAT, i);
+          const GVariantType *type;
+          GVariant *expected;
+          gconstpointer data;
+          guint64 scratch;
+          gsize size;
+
+          expected = g_variant_parse (NULL, typed_values[i], NULL, NULL, NULL);
+          g_variant_ref_sink (expected);
+
+          g_assert_true (gvdb_table_peek_value (table, key, &type, &data, &size,
+                                                &scratch, sizeof scratch));
+          g_assert_true (g_variant_type_equal (type, g_variant_get_type (expected)));
+
+          /* Only arrays of numbers and variants need to be swapped by
+           * allocating; everything else is available directly.
+           */
+          if (byteswap && (g_str_equal (typed_values[i], "[1, 2, 3]") ||
+                           g_str_equal (typed_values[i], "<42>")))
+            g_assert_null (data);
+          else
+            {
+              g_assert_nonnull (data);
+              g_assert_cmpmem (data, size,
+                               g_variant_get_data (expected),
+                               g_variant_get_size (expected));
+            }
+
+          /* Without scratch space, swapped numbers are not available */
+          g_assert_true (gvdb_table_peek_value (table, key, &type, &data, &size, NULL, 0));
+          if (byteswap && size > 1 && g_variant_type_is_basic (type) &&
+              !g_variant_type_is_subtype_of (type, G_VARIANT_TYPE_STRING))
+            g_assert_null (data);
+
+          g_variant_unref (expected);
+          g_free (key);
+        }
+
+      gvdb_table_free (table);
+    }
+}
+
 int
 main (int argc, char **argv)
 {
@@ -433,6 +851,10 @@ main (int argc, char **argv)
       g_snprintf (test_name, sizeof test_name, "/gvdb/reader/corrupted/%d%%", i);
       g_test_add_data_func (test_name, GINT_TO_POINTER (i), test_corrupted);
     }
+  g_test_add_func ("/gvdb/builder/bloom", test_builder_bloom);
+  g_test_add_func ("/gvdb/builder/deterministic", test_builder_deterministic);
+  g_test_add_func ("/gvdb/builder/inline", test_builder_inline);
+  g_test_add_func ("/gvdb/reader/peek", test_reader_peek);
 
   return g_test_run ();
 }
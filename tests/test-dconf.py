@@ -179,6 +179,7 @@ class DBusTest(unittest.TestCase):
             ['compile', 'output'],
             # Too many arguments:
             ['compile', 'output', 'dir1', 'dir2'],
+            ['compile', '-i', 'output', 'dir1', 'dir2'],
 
             # Missing arguments:
             ['_complete'],
@@ -213,6 +214,8 @@ class DBusTest(unittest.TestCase):
             ['load', '/key'],
             # Too many arguments:
             ['load', '/a/', '/b/'],
+            # Unknown option:
+            ['load', '-c', '/a/'],
 
             # Missing argument:
             ['read'],
@@ -429,6 +432,65 @@ class DBusTest(unittest.TestCase):
         keyfile_com = dconf('dump', '/com/').stdout
         self.assertEqual(keyfile_org, keyfile_com)
 
+    def test_load_chunked(self):
+        """Load applies the input in several change requests by default,
+        while with -a it applies nothing if any part of the input is invalid.
+        """
+        lines = ['[org/chunked]']
+        lines += ['key{:04}={}'.format(i, i) for i in range(2500)]
+        keyfile = '\n'.join(lines) + '\n'
+
+        dconf('load', '/', input=keyfile)
+        self.assertEqual(keyfile, dconf('dump', '/').stdout)
+        dconf('reset', '-f', '/')
+
+        invalid = keyfile.replace('[org/chunked]', '[org/atomic]') + 'bad=(\n'
+
+        with self.assertRaises(subprocess.CalledProcessError) as cm:
+            dconf('load', '-a', '/', input=invalid, stderr=subprocess.PIPE)
+        self.assertRegex(cm.exception.stderr, 'invalid value')
+        self.assertEqual('', dconf_read('/org/atomic/key0000'))
+
+        # Without -a the chunks before the error stay applied.
+        with self.assertRaises(subprocess.CalledProcessError) as cm:
+            dconf('load', '/', input=invalid, stderr=subprocess.PIPE)
+        self.assertRegex(cm.exception.stderr, 'invalid value')
+        self.assertEqual('0', dconf_read('/org/atomic/key0000'))
+        self.assertEqual('', dconf_read('/org/atomic/key2499'))
+
+    def test_load_keyfile_syntax(self):
+        """Load accepts the same input as GKeyFile would, even though it
+        parses the input incrementally.
+        """
+        keyfile = ('  # comment\r\n'
+                   '[org/syntax]  \t\r\n'
+                   '  spaced  =  1  \r\n'
+                   'tab\t=\t\'two\'\n'
+                   'localised[en_GB.UTF-8@euro]=3\n')
+
+        dconf('load', '/', input=keyfile)
+        self.assertEqual(dedent('''\
+        [org/syntax]
+        localised[en_GB.UTF-8@euro]=3
+        spaced=1
+        tab='two'
+        '''), dconf('dump', '/').stdout)
+
+        invalid = [
+            ('[org/bad\x01]\nkey=1\n', 'invalid group name'),
+            ('[org/bad]\nkey]=1\n', 'invalid key name'),
+            ('[org/bad]\nkey[x y]=1\n', 'invalid key name'),
+            ('[org/bad] x\nkey=1\n', 'not a key-value pair'),
+            ('key=1\n[org/bad]\n', 'does not start with a group'),
+        ]
+
+        for keyfile, message in invalid:
+            with self.subTest(keyfile=keyfile):
+                with self.assertRaises(subprocess.CalledProcessError) as cm:
+                    dconf('load', '/', input=keyfile, stderr=subprocess.PIPE)
+                self.assertRegex(cm.exception.stderr, message)
+                self.assertEqual('', dconf('dump', '/org/bad/').stdout)
+
     def test_complete(self):
         """Tests _complete command used internally to implement bash completion.
 
@@ -523,6 +585,32 @@ class DBusTest(unittest.TestCase):
         # Lexicographically last value should win:
         self.assertEqual(dconf_read('/org/file'), '99')
 
+    def test_compile_inline(self):
+        """Compile stores small values inline only when asked to, and the
+        result reads back the same either way.
+        """
+        user_d = os.path.join(self.temporary_dir.name, 'user.d')
+        os.mkdir(user_d)
+
+        keyfile = dedent('''\
+        [org/inline]
+        flag=true
+        number=42
+        text='not inline'
+        ''')
+
+        with open(os.path.join(user_d, 'a.conf'), 'w') as file:
+            file.write(keyfile)
+
+        plain = os.path.join(self.temporary_dir.name, 'plain')
+        dconf('compile', plain, user_d)
+
+        user = os.path.join(self.config_home, 'dconf', 'user')
+        dconf('compile', '-i', user, user_d)
+
+        self.assertLess(os.path.getsize(user), os.path.getsize(plain))
+        self.assertEqual(keyfile, dconf('dump', '/').stdout)
+
     def test_redundant_disk_writes(self):
         """Redundant disk writes are avoided.
 
@@ -592,6 +680,37 @@ class DBusTest(unittest.TestCase):
 
         self.assertEqual(a_conf, dconf('dump', '/').stdout)
 
+    def test_update_parallel(self):
+        """Update produces the same databases regardless of the number of
+        parallel jobs used.
+        """
+
+        db = os.path.join(self.temporary_dir.name, 'db')
+
+        for i in range(8):
+            conf_dir = os.path.join(db, 'site_{}.d'.format(i))
+            os.makedirs(conf_dir)
+
+            for j in range(16):
+                conf_file = os.path.join(conf_dir, '{:02}.conf'.format(j))
+                with open(conf_file, 'w') as file:
+                    file.write('[org/site{}]\n'.format(i))
+                    file.write('common={}\n'.format(j))
+                    file.write('file{}={}\n'.format(j, i * j))
+
+        def read_databases():
+            contents = {}
+            for i in range(8):
+                with open(os.path.join(db, 'site_{}'.format(i)), 'rb') as file:
+                    contents[i] = file.read()
+            return contents
+
+        dconf('update', '-j', '1', db)
+        serial = read_databases()
+
+        dconf('update', '-j', '4', db)
+        self.assertEqual(serial, read_databases())
+
     def test_database_invalidation(self):
         """Update invalidates previous database by overwriting the header with
         null bytes.
@@ -617,11 +736,49 @@ class DBusTest(unittest.TestCase):
                 # Sanity check that database is valid.
                 self.assertNotEqual(b'\0'*8, mm[:8])
 
+                with open(os.path.join(local_d, 'local.conf'), 'a') as file:
+                    file.write("picture-options = 'zoom'\n")
+
                 dconf('update', db)
 
                 # Now database should be marked as invalid.
                 self.assertEqual(b'\0'*8, mm[:8])
 
+    def test_update_unchanged(self):
+        """Update leaves databases alone when their inputs did not change."""
+
+        db = os.path.join(self.temporary_dir.name, 'db')
+        local = os.path.join(db, 'local')
+        local_d = os.path.join(db, 'local.d')
+        locks = os.path.join(local_d, 'locks')
+
+        os.makedirs(locks)
+
+        with open(os.path.join(local_d, 'local.conf'), 'w') as file:
+            file.write(dedent('''\
+            [org/gnome/desktop/background]
+            picture-uri = 'file:///usr/share/backgrounds/gnome/ColdWarm.jpg'
+            '''))
+
+        dconf('update', db)
+        saved = os.stat(local)
+
+        # Nothing changed, database is not rewritten.
+        dconf('update', db)
+        self.assertEqual(saved.st_ino, os.stat(local).st_ino)
+
+        # Touching an input without changing its contents is not a change.
+        os.utime(os.path.join(local_d, 'local.conf'))
+        dconf('update', db)
+        self.assertEqual(saved.st_ino, os.stat(local).st_ino)
+
+        # Adding a lock is.
+        with open(os.path.join(locks, 'background'), 'w') as file:
+            file.write('/org/gnome/desktop/background/picture-uri\n')
+
+        dconf('update', db)
+        self.assertNotEqual(saved.st_ino, os.stat(local).st_ino)
+
     def test_update_failure(self):
         """Update should skip invalid configuration directory and continue with
         others. Failure to update one of databases should be indicated with
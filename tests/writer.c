@@ -20,6 +20,7 @@
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <locale.h>
+#include <sys/socket.h>
 
 #include "service/dconf-generated.h"
 #include "service/dconf-writer.h"
@@ -378,6 +379,331 @@ static void test_writer_commit_real_changes (Fixture       *fixture,
   g_assert_cmpint (g_unlink (db_filename), ==, 0);
 }
 
+/**
+ * Test that a series of commits from the same writer, which update the
+ * on-disk database incrementally, produce the same contents as the
+ * in-memory state (as seen by a freshly-created writer).
+ */
+static void test_writer_commit_incremental (Fixture       *fixture,
+                                            gconstpointer  test_data)
+{
+  const char *db_name = "incremental";
+  g_autoptr(DConfWriter) writer = NULL;
+  g_autoptr(DConfWriter) reader = NULL;
+  DConfWriterClass *writer_class;
+  DConfChangeset *changes;
+  DConfChangeset *expected;
+  DConfChangeset *diff;
+  gboolean retval;
+  g_autoptr(GError) local_error = NULL;
+  g_autofree gchar *db_filename = g_build_filename (fixture->dconf_dir, db_name, NULL);
+  guint i;
+
+  /* Each step is a separate transaction.  The sets are applied in
+   * order, so the dir reset in the third step happens before the write
+   * underneath it.
+   */
+  struct { const gchar *path; const gchar *value; } steps[][3] = {
+    { { "/a/b/c", "one" }, { "/a/d", "two" }, { "/e", "three" } },
+    { { "/a/b/c", "four" }, { "/e", NULL } },
+    { { "/a/", NULL }, { "/a/b/f", "five" } },
+    { { "/a/b/f", NULL }, { "/g/h", "six" } },
+  };
+
+  writer = DCONF_WRITER (dconf_writer_new (DCONF_TYPE_WRITER, db_name));
+  writer_class = DCONF_WRITER_GET_CLASS (writer);
+  expected = dconf_changeset_new_database (NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (steps); i++)
+    {
+      guint j;
+
+      retval = writer_class->begin (writer, &local_error);
+      g_assert_no_error (local_error);
+      g_assert_true (retval);
+
+      changes = dconf_changeset_new ();
+      for (j = 0; j < G_N_ELEMENTS (steps[i]) && steps[i][j].path; j++)
+        {
+          GVariant *value = NULL;
+
+          if (steps[i][j].value)
+            value = g_variant_new_string (steps[i][j].value);
+
+          dconf_changeset_set (changes, steps[i][j].path, value);
+        }
+      writer_class->change (writer, changes, NULL);
+      dconf_changeset_change (expected, changes);
+      dconf_changeset_unref (changes);
+
+      retval = writer_class->commit (writer, &local_error);
+      g_assert_no_error (local_error);
+      g_assert_true (retval);
+
+      writer_class->end (writer);
+
+      /* A new writer reads the database back from disk */
+      reader = DCONF_WRITER (dconf_writer_new (DCONF_TYPE_WRITER, db_name));
+      retval = DCONF_WRITER_GET_CLASS (reader)->begin (reader, &local_error);
+      g_assert_no_error (local_error);
+      g_assert_true (retval);
+
+      diff = dconf_writer_diff (reader, expected);
+      g_assert_null (diff);
+
+      DCONF_WRITER_GET_CLASS (reader)->end (reader);
+      g_clear_object (&reader);
+    }
+
+  dconf_changeset_unref (expected);
+
+  /* Clean up. */
+  g_assert_cmpint (g_unlink (db_filename), ==, 0);
+}
+
+/* A writer that counts its commits, and a private D-Bus connection to
+ * drive it through the same handlers that the service uses.
+ */
+typedef DConfWriter      CountingWriter;
+typedef DConfWriterClass CountingWriterClass;
+
+static GType counting_writer_get_type (void);
+G_DEFINE_TYPE (CountingWriter, counting_writer, DCONF_TYPE_WRITER)
+
+static guint n_commits;
+
+static gboolean
+counting_writer_commit (DConfWriter  *writer,
+                        GError      **error)
+{
+  n_commits++;
+
+  return DCONF_WRITER_CLASS (counting_writer_parent_class)->commit (writer, error);
+}
+
+static void
+counting_writer_init (CountingWriter *writer)
+{
+}
+
+static void
+counting_writer_class_init (CountingWriterClass *class)
+{
+  class->commit = counting_writer_commit;
+}
+
+static void
+got_server_connection (GObject      *source,
+                       GAsyncResult *result,
+                       gpointer      user_data)
+{
+  GDBusConnection **server = user_data;
+  GError *error = NULL;
+
+  *server = g_dbus_connection_new_finish (result, &error);
+  g_assert_no_error (error);
+}
+
+static void
+connect_peers (GDBusConnection **server,
+               GDBusConnection **client)
+{
+  GSocketConnection *stream;
+  GSocket *socket;
+  GError *error = NULL;
+  gchar *guid;
+  gint fds[2];
+
+  g_assert_cmpint (socketpair (AF_UNIX, SOCK_STREAM, 0, fds), ==, 0);
+
+  /* The server side authenticates in a worker thread while we block on
+   * the client side below.
+   */
+  guid = g_dbus_generate_guid ();
+  socket = g_socket_new_from_fd (fds[0], &error);
+  g_assert_no_error (error);
+  stream = g_socket_connection_factory_create_connection (socket);
+  *server = NULL;
+  g_dbus_connection_new (G_IO_STREAM (stream), guid, G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_SERVER,
+                         NULL, NULL, got_server_connection, server);
+  g_object_unref (stream);
+  g_object_unref (socket);
+  g_free (guid);
+
+  socket = g_socket_new_from_fd (fds[1], &error);
+  g_assert_no_error (error);
+  stream = g_socket_connection_factory_create_connection (socket);
+  *client = g_dbus_connection_new_sync (G_IO_STREAM (stream), NULL, G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                        NULL, NULL, &error);
+  g_assert_no_error (error);
+  g_object_unref (stream);
+  g_object_unref (socket);
+
+  while (*server == NULL)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static GVariant *
+make_change_parameters (const gchar *key,
+                        GVariant    *value)
+{
+  DConfChangeset *changeset;
+  GVariant *serialised;
+  GVariant *blob;
+
+  changeset = dconf_changeset_new_write (key, value);
+  serialised = g_variant_ref_sink (dconf_changeset_serialise (changeset));
+  dconf_changeset_unref (changeset);
+
+  blob = g_variant_new_from_data (G_VARIANT_TYPE_BYTESTRING,
+                                  g_variant_get_data (serialised), g_variant_get_size (serialised), TRUE,
+                                  (GDestroyNotify) g_variant_unref, serialised);
+
+  return g_variant_new_tuple (&blob, 1);
+}
+
+static void
+got_reply (GObject      *source,
+           GAsyncResult *result,
+           gpointer      user_data)
+{
+  GVariant **reply = user_data;
+  GError *error = NULL;
+
+  *reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), result, &error);
+  g_assert_no_error (error);
+}
+
+static void
+call_writer (GDBusConnection  *client,
+             const gchar      *method,
+             GVariant         *parameters,
+             GVariant        **reply)
+{
+  *reply = NULL;
+  g_dbus_connection_call (client, NULL, "/ca/desrt/dconf/Writer/coalesce", "ca.desrt.dconf.Writer",
+                          method, parameters, NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, got_reply, reply);
+}
+
+static void
+record_notify (DConfDBusWriter     *writer,
+               const gchar         *prefix,
+               const gchar * const *changes,
+               const gchar         *tag,
+               gpointer             user_data)
+{
+  g_ptr_array_add (user_data, g_strdup (tag));
+}
+
+/**
+ * Test that changes arriving within the coalesce window are committed
+ * together, while each caller still gets its own tag and Notify.
+ */
+static void
+test_writer_coalesce (Fixture       *fixture,
+                      gconstpointer  test_data)
+{
+  g_autoptr(DConfWriter) writer = NULL;
+  g_autoptr(GDBusConnection) server = NULL;
+  g_autoptr(GDBusConnection) client = NULL;
+  g_autoptr(GPtrArray) notifies = g_ptr_array_new_with_free_func (g_free);
+  g_autoptr(GError) local_error = NULL;
+  g_autofree gchar *db_filename = g_build_filename (fixture->dconf_dir, "coalesce", NULL);
+  GVariant *replies[2];
+  const gchar *tags[2];
+
+  g_assert_true (g_setenv ("DCONF_WRITE_COALESCE_MS", "500", TRUE));
+  writer = DCONF_WRITER (dconf_writer_new (counting_writer_get_type (), "coalesce"));
+  g_unsetenv ("DCONF_WRITE_COALESCE_MS");
+
+  connect_peers (&server, &client);
+  g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (writer), server,
+                                    "/ca/desrt/dconf/Writer/coalesce", &local_error);
+  g_assert_no_error (local_error);
+  g_signal_connect (writer, "notify-signal", G_CALLBACK (record_notify), notifies);
+
+  n_commits = 0;
+  call_writer (client, "Change", make_change_parameters ("/a", g_variant_new_int32 (1)), &replies[0]);
+  call_writer (client, "Change", make_change_parameters ("/b", g_variant_new_int32 (2)), &replies[1]);
+
+  while (replies[0] == NULL || replies[1] == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (n_commits, ==, 1);
+
+  g_variant_get (replies[0], "(&s)", &tags[0]);
+  g_variant_get (replies[1], "(&s)", &tags[1]);
+  g_assert_cmpstr (tags[0], !=, tags[1]);
+
+  g_assert_cmpuint (notifies->len, ==, 2);
+  g_assert_cmpstr (notifies->pdata[0], ==, tags[0]);
+  g_assert_cmpstr (notifies->pdata[1], ==, tags[1]);
+
+  g_variant_unref (replies[0]);
+  g_variant_unref (replies[1]);
+
+  g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (writer));
+
+  /* Clean up. */
+  g_assert_cmpint (g_unlink (db_filename), ==, 0);
+}
+
+/**
+ * Test that an Init call commits anything still waiting in the coalesce
+ * window before it is handled itself.
+ */
+static void
+test_writer_coalesce_init (Fixture       *fixture,
+                           gconstpointer  test_data)
+{
+  g_autoptr(DConfWriter) writer = NULL;
+  g_autoptr(GDBusConnection) server = NULL;
+  g_autoptr(GDBusConnection) client = NULL;
+  g_autoptr(GPtrArray) notifies = g_ptr_array_new_with_free_func (g_free);
+  g_autoptr(GError) local_error = NULL;
+  g_autofree gchar *db_filename = g_build_filename (fixture->dconf_dir, "coalesce", NULL);
+  GVariant *change_reply;
+  GVariant *init_reply;
+  const gchar *tag;
+
+  /* Long enough that only the Init call can flush the queue */
+  g_assert_true (g_setenv ("DCONF_WRITE_COALESCE_MS", "600000", TRUE));
+  writer = DCONF_WRITER (dconf_writer_new (counting_writer_get_type (), "coalesce"));
+  g_unsetenv ("DCONF_WRITE_COALESCE_MS");
+
+  connect_peers (&server, &client);
+  g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (writer), server,
+                                    "/ca/desrt/dconf/Writer/coalesce", &local_error);
+  g_assert_no_error (local_error);
+  g_signal_connect (writer, "notify-signal", G_CALLBACK (record_notify), notifies);
+
+  n_commits = 0;
+  call_writer (client, "Change", make_change_parameters ("/a", g_variant_new_int32 (1)), &change_reply);
+  call_writer (client, "Init", NULL, &init_reply);
+
+  while (init_reply == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* The Change reply was sent first */
+  g_assert_nonnull (change_reply);
+  g_variant_get (change_reply, "(&s)", &tag);
+
+  g_assert_cmpuint (notifies->len, ==, 1);
+  g_assert_cmpstr (notifies->pdata[0], ==, tag);
+
+  /* One commit for the queued change, and one for the Init itself */
+  g_assert_cmpuint (n_commits, ==, 2);
+  g_assert_true (g_file_test (db_filename, G_FILE_TEST_EXISTS));
+
+  g_variant_unref (change_reply);
+  g_variant_unref (init_reply);
+
+  g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (writer));
+
+  /* Clean up. */
+  g_assert_cmpint (g_unlink (db_filename), ==, 0);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -426,6 +752,12 @@ main (int argc, char **argv)
               test_writer_commit_empty_changes, tear_down);
   g_test_add ("/writer/commit/redundant_change/2", Fixture, NULL, set_up,
               test_writer_commit_real_changes, tear_down);
+  g_test_add ("/writer/commit/incremental", Fixture, NULL, set_up,
+              test_writer_commit_incremental, tear_down);
+  g_test_add ("/writer/coalesce", Fixture, NULL, set_up,
+              test_writer_coalesce, tear_down);
+  g_test_add ("/writer/coalesce/init", Fixture, NULL, set_up,
+              test_writer_coalesce_init, tear_down);
 
   retval = g_test_run ();
 